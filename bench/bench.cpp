@@ -0,0 +1,411 @@
+// Microbenchmarks of BMP loading and exporting and of every filter class, on synthetic images of
+// several sizes. Prints the median time of each benchmark with its throughput in megapixels and
+// gigabytes per second, and compares them against a baseline saved by an earlier run.
+//
+//   bench_bmp_processor [--sizes=256,1024,4096] [--filter=<substring>[,...]] [--threads=<n>]
+//                       [--min-time=<seconds>] [--repetitions=<n>] [--json=<file>] [--baseline=<file>]
+//                       [--tolerance=<percent>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bitmap.h"
+#include "filter_context.h"
+#include "filters.h"
+#include "image_generator.h"
+#include "stats.h"
+#include "task_scheduler.h"
+#include "utils.h"
+#include "app_error.h"
+
+using namespace std::literals;
+
+struct BenchOptions {
+    std::vector<uint32_t> sizes = {256, 1024, 4096};
+    std::vector<std::string> filters;
+    size_t threads = 1;
+    double min_time = 0.5;
+    size_t repetitions = 1;
+    std::string json_path;
+    std::string baseline_path;
+    double tolerance = 10;
+};
+
+struct BenchResult {
+    std::string name;
+    uint32_t size;
+    double seconds;
+    double mpixels_per_second;
+    double gbytes_per_second;
+};
+
+// Filter under benchmark, created afresh for every image size.
+struct FilterBenchmark {
+    std::string name;
+    std::function<BaseFilter*(uint32_t size)> create;
+};
+
+static const std::vector<FilterBenchmark>& GetFilterBenchmarks() {
+    static const std::vector<FilterBenchmark> benchmarks = {
+        {"crop", [](uint32_t size) { return new CropFilter(size / 2, size / 2); }},
+        {"gs", [](uint32_t) { return new GrayscaleFilter(); }},
+        {"neg", [](uint32_t) { return new NegativeFilter(); }},
+        {"gamma 2.2", [](uint32_t) { return new GammaFilter(2.2); }},
+        {"lut(neg gamma 2.2)",
+         [](uint32_t) { return new ChannelLutFilter({new NegativeFilter(), new GammaFilter(2.2)}); }},
+        {"fused(gs neg)", [](uint32_t) { return new FusedPointFilter({new GrayscaleFilter(), new NegativeFilter()}); }},
+        {"sharp", [](uint32_t) { return new SharpeningFilter(); }},
+        {"edge 0.1", [](uint32_t) { return new EdgeDetectionFilter(0.1); }},
+        {"blur 1", [](uint32_t) { return new GaussianBlurFilter(1); }},
+        {"blur 3", [](uint32_t) { return new GaussianBlurFilter(3); }},
+        {"blur 8", [](uint32_t) { return new GaussianBlurFilter(8); }},
+        {"pixelate 0.25", [](uint32_t) { return new PixelateFilter(0.25); }},
+        {"tiled(gs sharp blur 2)",
+         [](uint32_t) {
+             return new TiledFilter({new GrayscaleFilter(), new SharpeningFilter(), new GaussianBlurFilter(2)});
+         }},
+    };
+    return benchmarks;
+}
+
+// 24-bit BMP file of deterministic noise, size x size pixels.
+static std::string MakeNoiseBMP(uint32_t size) {
+    std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+    ImageGenerator(size, size, ImageGenerator::Pattern::Noise).Write(stream);
+    return stream.str();
+}
+
+// Output stream buffer over memory allocated once, so exporting is timed without reallocations.
+class MemoryBuffer : public std::streambuf {
+public:
+    explicit MemoryBuffer(size_t capacity) : buffer_(capacity) {
+        Reset();
+    }
+
+    void Reset() {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+private:
+    std::vector<char> buffer_;
+};
+
+// Calls run() until min_time has passed and at least three times, after one warm-up call, and
+// returns the median time; prepare() runs untimed before every call.
+static double Measure(double min_time, const std::function<void()>& prepare, const std::function<void()>& run) {
+    using Clock = std::chrono::steady_clock;
+
+    prepare();
+    run();
+
+    std::vector<double> times;
+    double total = 0;
+    while (times.size() < 3 || (total < min_time && times.size() < 1000)) {
+        prepare();
+        auto start = Clock::now();
+        run();
+        times.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+        total += times.back();
+    }
+
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+static BenchResult MakeResult(const std::string& name, uint32_t size, double seconds, uint64_t bytes) {
+    const double pixels = static_cast<double>(size) * size;
+    return {name, size, seconds, pixels * 1e-6 / seconds, bytes * 1e-9 / seconds};
+}
+
+static std::vector<BenchResult> RunBenchmarks(const BenchOptions& options) {
+    std::unique_ptr<TaskScheduler> scheduler;
+    if (options.threads > 1) {
+        scheduler.reset(new TaskScheduler(options.threads));
+    }
+    auto selected = [&](std::string_view name) {
+        if (options.filters.empty()) {
+            return true;
+        }
+        for (const auto& filter : options.filters) {
+            if (name.find(filter) != std::string_view::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<BenchResult> results;
+    for (uint32_t size : options.sizes) {
+        const std::string file = MakeNoiseBMP(size);
+        Bitmap source;
+        {
+            std::istringstream stream(file);
+            source.Load(stream);
+        }
+        const uint64_t pixel_bytes = static_cast<uint64_t>(size) * size * sizeof(Color);
+
+        if (selected("load")) {
+            Bitmap image;
+            std::unique_ptr<std::istringstream> stream;
+            double seconds = Measure(
+                options.min_time, [&]() { stream.reset(new std::istringstream(file)); },
+                [&]() { image.Load(*stream); });
+            results.push_back(MakeResult("load", size, seconds, file.size() + pixel_bytes));
+        }
+
+        if (selected("export")) {
+            MemoryBuffer buffer(file.size());
+            std::ostream stream(&buffer);
+            double seconds = Measure(
+                options.min_time, [&]() { buffer.Reset(); }, [&]() { source.Export(stream); });
+            results.push_back(MakeResult("export", size, seconds, pixel_bytes + file.size()));
+        }
+
+        FilterContext context(scheduler.get());
+        for (const auto& benchmark : GetFilterBenchmarks()) {
+            if (!selected(benchmark.name)) {
+                continue;
+            }
+
+            std::unique_ptr<BaseFilter> filter(benchmark.create(size));
+            Bitmap image;
+            double seconds = Measure(
+                options.min_time, [&]() { image = source; }, [&]() { filter->Apply(image, context); });
+
+            // Every sweep reads the whole input and writes the whole output.
+            const uint64_t output_bytes = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight() * sizeof(Color);
+            const uint64_t bytes = filter->GetSweepCount() * (pixel_bytes + output_bytes);
+            results.push_back(MakeResult(benchmark.name, size, seconds, bytes));
+        }
+    }
+    return results;
+}
+
+// Runs the benchmarks `repetitions` times and keeps the median run of each, so that a slowdown
+// lasting a whole run, e.g. another process competing for the cores, counts only once.
+static std::vector<BenchResult> RepeatBenchmarks(const BenchOptions& options) {
+    std::vector<BenchResult> results = RunBenchmarks(options);
+    if (options.repetitions < 2) {
+        return results;
+    }
+
+    std::vector<std::vector<BenchResult>> runs(results.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        runs[i].push_back(results[i]);
+    }
+    for (size_t repetition = 1; repetition < options.repetitions; ++repetition) {
+        std::vector<BenchResult> repeated = RunBenchmarks(options);
+        for (size_t i = 0; i < results.size(); ++i) {
+            runs[i].push_back(repeated[i]);
+        }
+    }
+
+    auto faster = [](const BenchResult& a, const BenchResult& b) { return a.seconds < b.seconds; };
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::nth_element(runs[i].begin(), runs[i].begin() + runs[i].size() / 2, runs[i].end(), faster);
+        results[i] = runs[i][runs[i].size() / 2];
+    }
+    return results;
+}
+
+static void WriteResults(std::ostream& stream, const std::vector<BenchResult>& results) {
+    stream << "{\"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& result = results[i];
+        stream << (i ? ",\n" : "\n") << "  {\"name\": ";
+        WriteJsonString(stream, result.name);
+        stream << ", \"size\": " << result.size << ", \"seconds\": " << result.seconds
+               << ", \"mpixels_per_second\": " << result.mpixels_per_second
+               << ", \"gbytes_per_second\": " << result.gbytes_per_second << "}";
+    }
+    stream << "\n]}" << std::endl;
+}
+
+// Megapixels per second by benchmark name and size, from a file written by --json: one benchmark
+// per line. Throws BaselineFormatError on a benchmark line that doesn't parse or a file without
+// any, so that a damaged baseline can't pass the gate by comparing nothing.
+static std::map<std::pair<std::string, uint32_t>, double> ReadBaseline(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw AppError(AppError::InputFileIsNotOpen);
+    }
+
+    // Value following `key`, which includes its quotes and colon.
+    auto field = [](const std::string& line, std::string_view key) -> const char* {
+        size_t position = line.find(key);
+        return position == std::string::npos ? nullptr : line.c_str() + position + key.size();
+    };
+
+    std::map<std::pair<std::string, uint32_t>, double> baseline;
+    for (std::string line; std::getline(file, line);) {
+        const char* name = field(line, "\"name\": ");
+        if (!name) {
+            // The opening and closing lines of the list.
+            continue;
+        }
+        const char* size = field(line, "\"size\": ");
+        const char* throughput = field(line, "\"mpixels_per_second\": ");
+        const char* name_end = *name == '"' ? std::strchr(name + 1, '"') : nullptr;
+        if (!size || !throughput || !name_end) {
+            throw AppError(AppError::BaselineFormatError);
+        }
+
+        char* size_end = nullptr;
+        char* throughput_end = nullptr;
+        const unsigned long size_value = std::strtoul(size, &size_end, 10);
+        const double throughput_value = std::strtod(throughput, &throughput_end);
+        if (size_end == size || throughput_end == throughput || !(throughput_value > 0)) {
+            throw AppError(AppError::BaselineFormatError);
+        }
+        baseline[{std::string(name + 1, name_end), static_cast<uint32_t>(size_value)}] = throughput_value;
+    }
+    if (baseline.empty()) {
+        throw AppError(AppError::BaselineFormatError);
+    }
+    return baseline;
+}
+
+// Prints the results, marking those slower than the baseline by more than the tolerance and, when
+// there is a baseline, those missing from it. Returns the number of both.
+static size_t ReportResults(std::ostream& stream, const std::vector<BenchResult>& results,
+                            const std::map<std::pair<std::string, uint32_t>, double>& baseline, double tolerance) {
+    size_t name_width = 9;
+    for (const auto& result : results) {
+        name_width = std::max(name_width, result.name.size());
+    }
+
+    stream << std::left << std::setw(static_cast<int>(name_width)) << "Benchmark" << std::right << std::setw(7)
+           << "Size" << std::setw(12) << "Median ms" << std::setw(10) << "MP/s" << std::setw(8) << "GB/s";
+    if (!baseline.empty()) {
+        stream << std::setw(10) << "vs base";
+    }
+    stream << std::endl << std::fixed;
+
+    size_t failures = 0;
+    for (const auto& result : results) {
+        stream << std::left << std::setw(static_cast<int>(name_width)) << result.name << std::right << std::setw(7)
+               << result.size << std::setprecision(3) << std::setw(12) << result.seconds * 1e3 << std::setprecision(1)
+               << std::setw(10) << result.mpixels_per_second << std::setprecision(2) << std::setw(8)
+               << result.gbytes_per_second;
+
+        auto base = baseline.find({result.name, result.size});
+        if (base != baseline.end()) {
+            double change = 100 * (result.mpixels_per_second / base->second - 1);
+            stream << std::setprecision(1) << std::setw(9) << std::showpos << change << "%" << std::noshowpos;
+            if (change < -tolerance) {
+                stream << "  REGRESSION";
+                ++failures;
+            }
+        } else if (!baseline.empty()) {
+            // A renamed or new benchmark must be recorded before the gate can pass.
+            stream << std::setw(10) << "-" << "  NO BASELINE";
+            ++failures;
+        }
+        stream << std::endl;
+    }
+    stream << std::defaultfloat;
+    return failures;
+}
+
+// Benchmark names to match from a comma-separated list.
+static std::vector<std::string> ParseFilters(std::string_view list) {
+    std::vector<std::string> filters;
+    while (!list.empty()) {
+        size_t comma = std::min(list.find(','), list.size());
+        filters.emplace_back(list.substr(0, comma));
+        list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return filters;
+}
+
+static std::vector<uint32_t> ParseSizes(std::string_view list) {
+    std::vector<uint32_t> sizes;
+    while (!list.empty()) {
+        size_t comma = std::min(list.find(','), list.size());
+        sizes.push_back(SVToType<uint32_t>(list.substr(0, comma)));
+        if (sizes.back() == 0) {
+            throw AppError(AppError::InvalidOptionValue);
+        }
+        list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return sizes;
+}
+
+static BenchOptions ParseOptions(int argc, const char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view argument = argv[i];
+        size_t equals = argument.find('=');
+        if (argument.substr(0, 2) != "--"sv || equals == std::string_view::npos) {
+            throw AppError(AppError::UnknownOption);
+        }
+        std::string_view name = argument.substr(2, equals - 2);
+        std::string_view value = argument.substr(equals + 1);
+
+        if (name == "sizes"sv) {
+            options.sizes = ParseSizes(value);
+        } else if (name == "filter"sv) {
+            options.filters = ParseFilters(value);
+        } else if (name == "threads"sv) {
+            options.threads = SVToType<size_t>(value);
+        } else if (name == "min-time"sv) {
+            options.min_time = SVToType<double>(value);
+        } else if (name == "repetitions"sv) {
+            options.repetitions = SVToType<size_t>(value);
+        } else if (name == "json"sv) {
+            options.json_path = value;
+        } else if (name == "baseline"sv) {
+            options.baseline_path = value;
+        } else if (name == "tolerance"sv) {
+            options.tolerance = SVToType<double>(value);
+        } else {
+            throw AppError(AppError::UnknownOption);
+        }
+    }
+    return options;
+}
+
+int main(int argc, const char** argv) {
+    try {
+        const BenchOptions options = ParseOptions(argc, argv);
+
+        std::map<std::pair<std::string, uint32_t>, double> baseline;
+        if (!options.baseline_path.empty()) {
+            baseline = ReadBaseline(options.baseline_path);
+        }
+
+        const auto results = RepeatBenchmarks(options);
+        const size_t failures = ReportResults(std::cout, results, baseline, options.tolerance);
+
+        if (!options.json_path.empty()) {
+            std::ofstream file(options.json_path);
+            if (!file.is_open()) {
+                throw AppError(AppError::OutputFileIsNotOpen);
+            }
+            WriteResults(file, results);
+        }
+
+        if (failures) {
+            std::cerr << failures << " benchmarks regressed by more than " << options.tolerance
+                      << "% or have no baseline." << std::endl;
+            return 1;
+        }
+    } catch (const AppError& e) {
+        e.PrintMessage();
+        return 2;
+    }
+    return 0;
+}
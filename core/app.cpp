@@ -1,28 +1,248 @@
 #include "app.h"
 
+#include <fstream>
+#include <iostream>
+#include <memory>
 #include <vector>
 #include <string_view>
+#include <thread>
 
+#include <pthread.h>
+#include <signal.h>
+
+#include "batch.h"
 #include "bitmap.h"
+#include "image_generator.h"
+#include "result_cache.h"
+#include "perf_counters.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
 #include "filter_pipeline.h"
+#include "server.h"
 #include "app_error.h"
 
-void App::Run() const {
+using namespace std::string_view_literals;
+
+// Runs a server until SIGINT or SIGTERM, then stops it so that it removes its socket file. The
+// signals are blocked before the server starts its threads, which inherit the mask, and are
+// taken by a thread of their own.
+static void Serve(std::string_view socket_path, size_t threads, size_t memory_limit) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    Server server(socket_path, threads, memory_limit);
+    std::thread signal_thread([&server, &signals] {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        server.Stop();
+    });
+
+    server.Run();
+
+    // Run may also end on an error; the signal thread is then still waiting.
+    pthread_kill(signal_thread.native_handle(), SIGTERM);
+    signal_thread.join();
+}
+
+int App::Run() const {
     try {
         FiltersParser parser(argc_, argv_);
 
-        std::string_view input_path = parser.ParseInputPath();
-        std::string_view output_path = parser.ParseOutputPath();
         std::vector<FilterInfo> parsed_filters = parser.ParseFilters();
 
-        Bitmap image;
-        image.LoadFromBMP(input_path);
+        bool explain = false;
+        bool report_utilization = false;
+        bool batch = false;
+        std::string_view batch_list;
+        BatchOptions batch_options;
+        std::string_view socket_path;
+        std::string_view cache_directory;
+        uint64_t cache_size = uint64_t(1) << 30;
+        std::string_view checkpoint_directory;
+        uint64_t checkpoint_size = uint64_t(4) << 30;
+        bool report_cache_stats = false;
+        std::unique_ptr<StageStats> stage_stats;
+        bool report_stats = false;
+        bool stats_as_json = false;
+        bool hardware_counters = false;
+        std::unique_ptr<TraceRecorder> trace;
+        std::string_view trace_path;
+        std::string_view generate_pattern;
+        std::pair<uint32_t, uint32_t> generate_size(1024, 1024);
+        uint64_t generate_seed = 0;
+        PipelineOptions pipeline_options;
+        for (const auto& [name, value] : parser.ParseOptions()) {
+            if (name == "bpp"sv) {
+                batch_options.bits_per_pixel = SVToType<uint32_t>(value);
+                if (batch_options.bits_per_pixel != 24 && batch_options.bits_per_pixel != 1) {
+                    throw AppError(AppError::InvalidOptionValue);
+                }
+            } else if (name == "optimize"sv) {
+                pipeline_options.optimize = true;
+            } else if (name == "tiled"sv) {
+                pipeline_options.tiled = true;
+            } else if (name == "threads"sv) {
+                pipeline_options.threads = SVToType<size_t>(value);
+            } else if (name == "utilization"sv) {
+                report_utilization = true;
+            } else if (name == "explain"sv) {
+                explain = true;
+            } else if (name == "batch"sv) {
+                batch = true;
+                batch_list = value;
+            } else if (name == "jobs"sv) {
+                batch_options.max_images = SVToType<size_t>(value);
+            } else if (name == "cache"sv) {
+                cache_directory = value;
+            } else if (name == "checkpoints"sv) {
+                checkpoint_directory = value;
+            } else if (name == "cache-size"sv) {
+                cache_size = SVToByteSize(value);
+            } else if (name == "checkpoint-size"sv) {
+                checkpoint_size = SVToByteSize(value);
+            } else if (name == "cache-stats"sv) {
+                report_cache_stats = true;
+            } else if (name == "stats"sv) {
+                if (!value.empty() && value != "json"sv) {
+                    throw AppError(AppError::InvalidOptionValue);
+                }
+                report_stats = true;
+                stats_as_json = !value.empty();
+            } else if (name == "perf-counters"sv) {
+                report_stats = true;
+                hardware_counters = true;
+            } else if (name == "trace"sv) {
+                if (value.empty()) {
+                    throw AppError(AppError::InvalidOptionValue);
+                }
+                trace.reset(new TraceRecorder());
+                trace_path = value;
+                pipeline_options.trace = trace.get();
+            } else if (name == "generate"sv) {
+                if (value.empty()) {
+                    throw AppError(AppError::InvalidOptionValue);
+                }
+                generate_pattern = value;
+            } else if (name == "size"sv) {
+                generate_size = SVToImageSize(value);
+            } else if (name == "seed"sv) {
+                generate_seed = SVToType<uint64_t>(value);
+            } else if (name == "serve"sv) {
+                if (value.empty()) {
+                    throw AppError(AppError::InvalidOptionValue);
+                }
+                socket_path = value;
+            } else if (name == "memory-limit"sv) {
+                batch_options.memory_limit = SVToByteSize(value);
+            } else {
+                throw AppError(AppError::UnknownOption);
+            }
+        }
+
+        if (hardware_counters && !PerfCounters::IsAvailable()) {
+            std::cerr << "Hardware counters are not available, reporting without them." << std::endl;
+            hardware_counters = false;
+        }
+        if (report_stats) {
+            stage_stats.reset(new StageStats(hardware_counters));
+            pipeline_options.stats = stage_stats.get();
+        }
+
+        if (!generate_pattern.empty()) {
+            if (!parsed_filters.empty()) {
+                throw AppError(AppError::GeneratedImageFilters);
+            }
+            ImageGenerator(generate_size.first, generate_size.second, ImageGenerator::ParsePattern(generate_pattern),
+                           generate_seed)
+                .WriteToFile(parser.ParseOutputPath(), batch_options.bits_per_pixel);
+            return 0;
+        }
+
+        if (!socket_path.empty()) {
+            // The server runs requests with options of their own, so these would have no effect.
+            if (!cache_directory.empty() || !checkpoint_directory.empty() || report_stats || trace) {
+                throw AppError(AppError::ServeOptionConflict);
+            }
+            Serve(socket_path, ResolveThreadCount(pipeline_options.threads), batch_options.memory_limit);
+            return 0;
+        }
+
+        std::unique_ptr<ResultCache> checkpoints;
+        if (!checkpoint_directory.empty()) {
+            checkpoints.reset(new ResultCache(checkpoint_directory, checkpoint_size, ".raw"));
+            pipeline_options.checkpoints = checkpoints.get();
+        }
+
+        FiltersPipeline filter_pipeline(parsed_filters, pipeline_options);
+
+        if (explain) {
+            filter_pipeline.Explain(std::cout);
+            return 0;
+        }
+
+        std::unique_ptr<ResultCache> cache;
+        if (!cache_directory.empty()) {
+            cache.reset(new ResultCache(cache_directory, cache_size));
+            batch_options.cache = cache.get();
+        }
+
+        // Opened up front, so that an unwritable path fails before the work rather than after it.
+        std::ofstream trace_file;
+        if (trace) {
+            trace_file.open(trace_path.data());
+            if (!trace_file.is_open()) {
+                throw AppError(AppError::TraceFileIsNotOpen);
+            }
+        }
 
-        FiltersPipeline filter_pipeline(parsed_filters);
-        filter_pipeline.Apply(image);
+        // Reports are written also when the run stops on an error, when they are most wanted.
+        auto report = [&]() {
+            if (report_utilization) {
+                filter_pipeline.GetScheduler().ReportUtilization(std::cerr);
+            }
+            if (report_cache_stats && cache) {
+                cache->ReportStats(std::cerr);
+            }
+            if (report_cache_stats && checkpoints) {
+                checkpoints->ReportStats(std::cerr, "Checkpoints");
+            }
+            if (stage_stats && stats_as_json) {
+                stage_stats->ReportJson(std::cerr);
+            } else if (stage_stats) {
+                stage_stats->ReportTable(std::cerr);
+            }
+            if (trace) {
+                trace->Write(trace_file);
+                trace_file.flush();
+            }
+        };
 
-        image.ExportAsBMP(output_path);
+        BatchProcessor processor(filter_pipeline, batch_options);
+        size_t failed_images = 0;
+        try {
+            if (batch) {
+                std::vector<BatchJob> jobs;
+                if (parser.HasPaths()) {
+                    jobs = BatchProcessor::ListDirectory(parser.ParseInputPath(), parser.ParseOutputPath());
+                } else {
+                    jobs = BatchProcessor::ReadJobList(batch_list);
+                }
+                failed_images = processor.Run(jobs);
+            } else {
+                processor.Process({std::string(parser.ParseInputPath()), std::string(parser.ParseOutputPath())});
+            }
+        } catch (...) {
+            report();
+            throw;
+        }
+        report();
+        return failed_images > 0 ? 1 : 0;
     } catch (const AppError& e) {
         e.PrintMessage();
+        return 1;
     }
 }
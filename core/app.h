@@ -4,7 +4,9 @@ class App {
 public:
     App(int argc, const char** argv) : argc_(argc), argv_(argv) {}
 
-    void Run() const;
+    // Returns the exit status: 0 if everything succeeded, 1 if anything failed, including any
+    // image of a batch.
+    int Run() const;
 
 private:
     int argc_;
@@ -0,0 +1,229 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+
+#include "bitmap.h"
+#include "app_error.h"
+
+namespace fs = std::filesystem;
+
+// Calls a function when leaving the scope, however it is left.
+class ScopeExit {
+public:
+    explicit ScopeExit(std::function<void()> func) : func_(std::move(func)) {}
+
+    ScopeExit(const ScopeExit&) = delete;
+    ScopeExit& operator=(const ScopeExit&) = delete;
+
+    ~ScopeExit() {
+        func_();
+    }
+
+private:
+    std::function<void()> func_;
+};
+
+BatchProcessor::BatchProcessor(FiltersPipeline& pipeline, const BatchOptions& options)
+    : pipeline_(pipeline), options_(options),
+      cache_plan_(pipeline.GetCanonicalPlan() + " --bpp=" + std::to_string(options.bits_per_pixel)) {}
+
+std::vector<BatchJob> BatchProcessor::ReadJobList(std::string_view list_path) {
+    std::ifstream file(list_path.data());
+
+    if (!file.is_open()) {
+        throw AppError(AppError::BatchListIsNotOpen);
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string input_path;
+    while (file >> input_path) {
+        std::string output_path;
+        if (!(file >> output_path)) {
+            throw AppError(AppError::BatchListFormatError);
+        }
+        jobs.push_back({std::move(input_path), std::move(output_path)});
+    }
+
+    return jobs;
+}
+
+std::vector<BatchJob> BatchProcessor::ListDirectory(std::string_view input_dir, std::string_view output_dir) {
+    std::error_code error;
+    fs::directory_iterator entries(input_dir, error);
+    if (error) {
+        throw AppError(AppError::BatchDirectoryError);
+    }
+    fs::create_directories(output_dir, error);
+    if (error) {
+        throw AppError(AppError::BatchDirectoryError);
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const auto& entry : entries) {
+        if (entry.is_regular_file() && entry.path().extension() == ".bmp") {
+            jobs.push_back({entry.path().string(), (fs::path(output_dir) / entry.path().filename()).string()});
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& lhs, const BatchJob& rhs) {
+        return lhs.input_path < rhs.input_path;
+    });
+
+    return jobs;
+}
+
+size_t BatchProcessor::Run(const std::vector<BatchJob>& jobs) {
+    TaskScheduler& scheduler = pipeline_.GetScheduler();
+
+    // A file whose header cannot be read is estimated at the whole memory limit, so that it runs
+    // alone: it most likely fails as soon as it runs, but what it would allocate is unknown.
+    std::vector<size_t> estimates(jobs.size(), options_.memory_limit);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        try {
+            Bitmap::DIBHeader header = Bitmap::ReadDIBHeader(jobs[i].input_path);
+            estimates[i] = pipeline_.EstimateMemory(header.image_width, header.image_height, options_.bits_per_pixel);
+        } catch (const AppError&) {
+        } catch (const std::exception&) {
+        }
+    }
+
+    size_t max_images = options_.max_images;
+    if (max_images == 0) {
+        max_images = scheduler.GetThreadCount();
+    }
+
+    std::mutex mutex;
+    AdmissionController admission(options_.memory_limit, max_images);
+    std::list<size_t> pending_jobs(jobs.size());
+    std::iota(pending_jobs.begin(), pending_jobs.end(), 0);
+    size_t failed_jobs = 0;
+
+    // Starts every pending job that fits, in order. Called with the mutex held: first here, then by
+    // every job that finishes and so frees room.
+    TaskScheduler::TaskGroup group;
+    std::function<void()> admit_jobs = [&]() {
+        for (auto it = pending_jobs.begin(); it != pending_jobs.end() && !admission.IsFull();) {
+            const size_t i = *it;
+            if (!admission.CanAdmit(estimates[i])) {
+                ++it;
+                continue;
+            }
+
+            admission.Admit(estimates[i]);
+            it = pending_jobs.erase(it);
+            scheduler.Submit(group, [&, i]() {
+                // The job's room is given back and the next jobs started even if Process throws
+                // something unexpected, which Wait then rethrows.
+                bool failed = true;
+                ScopeExit finish([&]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    failed_jobs += failed;
+                    admission.Release(estimates[i]);
+                    admit_jobs();
+                });
+
+                try {
+                    Process(jobs[i]);
+                    failed = false;
+                } catch (const AppError& e) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::cerr << jobs[i].input_path << ": ";
+                    e.PrintMessage();
+                } catch (const std::exception& e) {
+                    // A damaged header may ask for more memory than there is, or the file may go
+                    // away under fs::file_size; neither is a reason to stop the batch.
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::cerr << jobs[i].input_path << ": " << e.what() << std::endl;
+                }
+            });
+        }
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        admit_jobs();
+    }
+    scheduler.Wait(group);
+
+    peak_memory_ = admission.GetPeakBytes();
+    return failed_jobs;
+}
+
+void BatchProcessor::Process(const BatchJob& job) const {
+    StageStats* stats = pipeline_.GetStats();
+    const bool hardware_counters = stats && stats->HasHardwareCounters();
+    TraceRecorder* trace = pipeline_.GetTrace();
+    TraceSpan image_span(trace, "image", "image", trace ? job.input_path : std::string());
+
+    TraceSpan load_span(trace, "load", "io");
+    StageTimer load_timer(hardware_counters);
+
+    Bitmap image;
+    uint64_t input_size = 0;
+    std::string cache_key;
+    if (options_.cache) {
+        // The cache is keyed by the file's bytes, which are then decoded from memory on a miss.
+        std::ifstream file(job.input_path, std::ios_base::in | std::ios_base::binary);
+        if (!file.is_open()) {
+            throw AppError(AppError::InputFileIsNotOpen);
+        }
+        std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        input_size = input.size();
+
+        cache_key = ResultCache::MakeKey(input, cache_plan_);
+        TraceSpan fetch_span(trace, "cache fetch", "io");
+        if (options_.cache->Fetch(cache_key, job.output_path)) {
+            return;
+        }
+        fetch_span.End();
+
+        std::istringstream stream(std::move(input));
+        image.Load(stream);
+    } else {
+        image.LoadFromBMP(job.input_path);
+        if (stats) {
+            input_size = fs::file_size(job.input_path);
+        }
+    }
+
+    const uint64_t input_pixels = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight();
+    if (stats) {
+        stats->Record("load", load_timer.Stop(input_pixels, input_size, input_pixels * sizeof(Color)));
+    }
+    load_span.End();
+
+    // A context per image, so its back buffer is freed together with the image.
+    FilterContext context = pipeline_.CreateContext();
+    if (options_.bits_per_pixel == 1) {
+        BitMask mask = pipeline_.ApplyAsMask(image, context);
+        TraceSpan export_span(trace, "export", "io");
+        StageTimer export_timer(hardware_counters);
+        mask.ExportAsBMP(job.output_path);
+        if (stats) {
+            const uint64_t pixels = static_cast<uint64_t>(mask.GetWidth()) * mask.GetHeight();
+            stats->Record("export", export_timer.Stop(pixels, (pixels + 7) / 8, fs::file_size(job.output_path)));
+        }
+    } else {
+        pipeline_.Apply(image, context);
+        TraceSpan export_span(trace, "export", "io");
+        StageTimer export_timer(hardware_counters);
+        image.ExportAsBMP(job.output_path);
+        if (stats) {
+            const uint64_t pixels = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight();
+            stats->Record("export", export_timer.Stop(pixels, pixels * sizeof(Color), fs::file_size(job.output_path)));
+        }
+    }
+
+    if (options_.cache) {
+        TraceSpan store_span(trace, "cache store", "io");
+        options_.cache->Store(cache_key, job.output_path);
+    }
+}
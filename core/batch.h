@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "filter_pipeline.h"
+#include "result_cache.h"
+
+struct BatchJob {
+    std::string input_path;
+    std::string output_path;
+};
+
+struct BatchOptions {
+    // Images in flight at once, 0 stands for one per thread of the pipeline.
+    size_t max_images = 0;
+    // Bytes the images in flight may take together, as estimated by the pipeline; 0 means no limit.
+    size_t memory_limit = 0;
+    uint32_t bits_per_pixel = 24;
+    // Cache of outputs to look every image up in first, must outlive the processor.
+    ResultCache* cache = nullptr;
+};
+
+// Decides which jobs may start: a job is admitted while fewer than max_jobs run and the estimates
+// of the running jobs plus its own fit in the memory limit. A job too large to fit even alone is
+// admitted once nothing else runs. Not thread-safe.
+class AdmissionController {
+public:
+    AdmissionController(size_t memory_limit, size_t max_jobs) : memory_limit_(memory_limit), max_jobs_(max_jobs) {}
+
+    bool IsFull() const {
+        return running_jobs_ >= max_jobs_;
+    }
+
+    bool CanAdmit(size_t bytes) const {
+        if (IsFull()) {
+            return false;
+        }
+        return running_jobs_ == 0 || memory_limit_ == 0 || running_bytes_ + bytes <= memory_limit_;
+    }
+
+    void Admit(size_t bytes) {
+        ++running_jobs_;
+        running_bytes_ += bytes;
+        peak_bytes_ = std::max(peak_bytes_, running_bytes_);
+    }
+
+    void Release(size_t bytes) {
+        --running_jobs_;
+        running_bytes_ -= bytes;
+    }
+
+    // Largest sum of estimates that ran at once.
+    size_t GetPeakBytes() const {
+        return peak_bytes_;
+    }
+
+private:
+    size_t memory_limit_;
+    size_t max_jobs_;
+    size_t running_jobs_ = 0;
+    size_t running_bytes_ = 0;
+    size_t peak_bytes_ = 0;
+};
+
+// Runs one pipeline over many images in a single process, each image with its own FilterContext.
+// Every job's memory is estimated from its BMP header and the pipeline's plan before the batch
+// starts, and jobs are started in order as AdmissionController lets them: large images run alone,
+// small ones pack densely and may overtake a large one waiting for room. The filters of every
+// image still split their rows between all threads of the pipeline's scheduler.
+class BatchProcessor {
+public:
+    BatchProcessor(FiltersPipeline& pipeline, const BatchOptions& options = {});
+
+    // Jobs from a text file of whitespace separated <input> <output> pairs.
+    static std::vector<BatchJob> ReadJobList(std::string_view list_path);
+
+    // A job for every .bmp file of input_dir, written under the same name to output_dir, which is
+    // created if missing.
+    static std::vector<BatchJob> ListDirectory(std::string_view input_dir, std::string_view output_dir);
+
+    // Processes all jobs. An image that cannot be processed is reported to std::cerr and skipped;
+    // returns the number of such images.
+    size_t Run(const std::vector<BatchJob>& jobs);
+
+    // Processes a single image, throwing its errors.
+    void Process(const BatchJob& job) const;
+
+    // Largest estimated memory of the images in flight at once during the last Run.
+    size_t GetPeakMemory() const {
+        return peak_memory_;
+    }
+
+private:
+    FiltersPipeline& pipeline_;
+    BatchOptions options_;
+    // What the cache key has to cover besides the input: the plan and the output format.
+    std::string cache_plan_;
+    size_t peak_memory_ = 0;
+};
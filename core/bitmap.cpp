@@ -5,14 +5,46 @@
 
 #include "app_error.h"
 
-void Bitmap::Load(std::istream& stream) {
-    stream.read(reinterpret_cast<char*>(&bmp_header_), sizeof(bmp_header_));
+void Bitmap::ReadHeaders(std::istream& stream, BMPHeader& bmp_header, DIBHeader& dib_header) {
+    stream.read(reinterpret_cast<char*>(&bmp_header), sizeof(bmp_header));
 
-    if (bmp_header_.signature != *reinterpret_cast<const int16_t*>("BM")) {
+    if (bmp_header.signature != *reinterpret_cast<const int16_t*>("BM")) {
         throw AppError(AppError::FileSignatureError);
     }
 
-    stream.read(reinterpret_cast<char*>(&dib_header_), sizeof(dib_header_));
+    stream.read(reinterpret_cast<char*>(&dib_header), sizeof(dib_header));
+
+    if (!stream) {
+        throw AppError(AppError::FileHeaderError);
+    }
+}
+
+// Bytes from the read position to the end of the stream, which is left where it was.
+static uint64_t GetRemainingSize(std::istream& stream) {
+    const auto position = stream.tellg();
+    stream.seekg(0, std::ios_base::end);
+    const auto end = stream.tellg();
+    stream.seekg(position);
+    if (position < 0 || end < position) {
+        throw AppError(AppError::PixelArrayTruncated);
+    }
+    return static_cast<uint64_t>(end - position);
+}
+
+void Bitmap::CheckPixelArray(std::istream& stream, const DIBHeader& dib_header) {
+    if (dib_header.bits_per_pixel != 24 || dib_header.compression != 0) {
+        throw AppError(AppError::UnsupportedBitmapFormat);
+    }
+
+    const uint64_t row_size = (uint64_t{dib_header.image_width} * 3 + 3) / 4 * 4;
+    if (row_size > 0 && dib_header.image_height > GetRemainingSize(stream) / row_size) {
+        throw AppError(AppError::PixelArrayTruncated);
+    }
+}
+
+void Bitmap::Load(std::istream& stream) {
+    ReadHeaders(stream, bmp_header_, dib_header_);
+    CheckPixelArray(stream, dib_header_);
 
     base_width_ = dib_header_.image_width;
     base_height_ = dib_header_.image_height;
@@ -24,10 +56,7 @@ void Bitmap::Load(std::istream& stream) {
         row_padding = 4 - row_padding;
     }
 
-    if (data_ != nullptr) {
-        delete[] data_;
-    }
-    data_ = new Color[base_width_ * base_height_];
+    data_.resize(static_cast<size_t>(base_width_) * base_height_);
 
     for (uint32_t y = 0; y < base_height_; ++y) {
         for (uint32_t x = 0; x < base_width_; ++x) {
@@ -42,7 +71,7 @@ void Bitmap::Load(std::istream& stream) {
             Color pixel;
             pixel.Set(red / 255.0, green / 255.0, blue / 255.0);
 
-            data_[y * base_width_ + x] = pixel;
+            data_[static_cast<size_t>(y) * base_width_ + x] = pixel;
         }
         stream.ignore(row_padding);
     }
@@ -58,6 +87,24 @@ void Bitmap::LoadFromBMP(std::string_view file_name) {
     Load(file);
 }
 
+Bitmap::DIBHeader Bitmap::ReadDIBHeader(std::string_view file_name) {
+    std::ifstream file(file_name.data(), std::ios_base::in | std::ios_base::binary);
+
+    if (!file.is_open()) {
+        throw AppError(AppError::InputFileIsNotOpen);
+    }
+
+    return ReadDIBHeader(file);
+}
+
+Bitmap::DIBHeader Bitmap::ReadDIBHeader(std::istream& stream) {
+    BMPHeader bmp_header;
+    DIBHeader dib_header;
+    ReadHeaders(stream, bmp_header, dib_header);
+    CheckPixelArray(stream, dib_header);
+    return dib_header;
+}
+
 void Bitmap::Export(std::ostream& stream) const {
     stream.write(reinterpret_cast<const char*>(&bmp_header_), sizeof(bmp_header_));
     stream.write(reinterpret_cast<const char*>(&dib_header_), sizeof(dib_header_));
@@ -95,18 +142,49 @@ void Bitmap::ExportAsBMP(std::string_view file_path) const {
     Export(file);
 }
 
+void Bitmap::ExportRaw(std::ostream& stream) const {
+    stream.write(reinterpret_cast<const char*>(&bmp_header_), sizeof(bmp_header_));
+    stream.write(reinterpret_cast<const char*>(&dib_header_), sizeof(dib_header_));
+
+    for (uint32_t y = 0; y < height_; ++y) {
+        stream.write(reinterpret_cast<const char*>(GetRow(y)), sizeof(Color) * width_);
+    }
+}
+
+void Bitmap::LoadRaw(std::istream& stream) {
+    ReadHeaders(stream, bmp_header_, dib_header_);
+
+    base_width_ = dib_header_.image_width;
+    base_height_ = dib_header_.image_height;
+    width_ = base_width_;
+    height_ = base_height_;
+
+    // A damaged header must not make us allocate pixels that the file doesn't have.
+    const size_t pixel_count = static_cast<size_t>(base_width_) * base_height_;
+    if (GetRemainingSize(stream) / sizeof(Color) < pixel_count) {
+        throw AppError(AppError::PixelArrayTruncated);
+    }
+
+    data_.resize(pixel_count);
+    stream.read(reinterpret_cast<char*>(data_.data()), sizeof(Color) * data_.size());
+
+    if (!stream) {
+        throw AppError(AppError::FileHeaderError);
+    }
+}
+
 bool Bitmap::operator==(const Bitmap& other) const {
-    if (data_ == nullptr || other.data_ == nullptr) {
-        return data_ == other.data_;
+    if (data_.empty() || other.data_.empty()) {
+        return data_.empty() == other.data_.empty();
     }
 
-    if (base_width_ != other.base_width_ || base_height_ != other.base_height_) {
+    if (width_ != other.width_ || height_ != other.height_) {
         return false;
     }
 
-    for (uint32_t i = 0; i < base_height_; ++i) {
-        for (uint32_t j = 0; j < base_width_; ++j) {
-            if (data_[base_width_ * i + j] != other.data_[base_width_ * i + j]) {
+    for (uint32_t i = 0; i < height_; ++i) {
+        for (uint32_t j = 0; j < width_; ++j) {
+            if (data_[base_width_ * i + j] != other.data_[other.base_width_ * i + j]) {
                 return false;
             }
         }
@@ -58,37 +58,72 @@ public:
     void Load(std::istream& stream);
     void LoadFromBMP(std::string_view file_name);
 
+    // Header of a BMP file, read without loading its pixels. Throws the errors Load would for a
+    // file that is not a 24-bit uncompressed BMP or is too short for the size in its header, so
+    // the size can be trusted. The stream is left after the header.
+    static DIBHeader ReadDIBHeader(std::string_view file_name);
+    static DIBHeader ReadDIBHeader(std::istream& stream);
+
     void Export(std::ostream& stream) const;
     void ExportAsBMP(std::string_view file_path) const;
 
-    uint32_t GetWidth() {
+    // Lossless form of the image: its headers followed by the visible pixels as they are in
+    // memory, for checkpoints the pipeline resumes from.
+    void ExportRaw(std::ostream& stream) const;
+    void LoadRaw(std::istream& stream);
+
+    uint32_t GetWidth() const {
         return width_;
     }
-    uint32_t GetHeight() {
+    uint32_t GetHeight() const {
         return height_;
     }
 
+    uint32_t GetStride() const {
+        return base_width_;
+    }
+
     Color& GetPixel(uint32_t x, uint32_t y) {
         return data_[base_width_ * y + x];
     }
 
+    Color* GetRow(uint32_t y) {
+        return data_.data() + base_width_ * y;
+    }
+    const Color* GetRow(uint32_t y) const {
+        return data_.data() + base_width_ * y;
+    }
+
+    // Size of the pixel storage, including pixels hidden by Crop.
+    size_t GetPixelCount() const {
+        return data_.size();
+    }
+
+    // Exchanges the pixel storage with a buffer of the same size and row layout, e.g. one a filter
+    // has just rendered its output into. The old pixels are left in `pixels` for reuse.
+    void SwapPixels(std::vector<Color>& pixels) {
+        data_.swap(pixels);
+    }
+
     Color& GetClosestPixel(int64_t x, int64_t y);
 
     void Crop(uint32_t new_width, uint32_t new_height);
 
+    // Compares the visible pixels only.
     bool operator==(const Bitmap& other) const;
 
-    ~Bitmap() {
-        delete[] data_;
-    }
-
 protected:
+    static void ReadHeaders(std::istream& stream, BMPHeader& bmp_header, DIBHeader& dib_header);
+    // Throws unless the pixels `dib_header` describes are 24-bit, uncompressed and fit in what is
+    // left of the stream, so that a damaged header can't make Load allocate without bound.
+    static void CheckPixelArray(std::istream& stream, const DIBHeader& dib_header);
+
     BMPHeader bmp_header_;
     DIBHeader dib_header_;
 
     uint32_t base_width_;
     uint32_t base_height_;
-    Color* data_ = nullptr;
+    std::vector<Color> data_;
 
     uint32_t width_;
     uint32_t height_;
@@ -0,0 +1,46 @@
+#include "bitmask.h"
+
+#include <fstream>
+
+#include "bitmap.h"
+#include "app_error.h"
+
+void BitMask::Export(std::ostream& stream) const {
+    const uint8_t color_table[] = {0, 0, 0, 0, 255, 255, 255, 0};
+
+    Bitmap::BMPHeader bmp_header;
+    Bitmap::DIBHeader dib_header;
+
+    dib_header.dib_header_size = sizeof(dib_header);
+    dib_header.image_width = width_;
+    dib_header.image_height = height_;
+    dib_header.planes = 1;
+    dib_header.bits_per_pixel = 1;
+    dib_header.compression = 0;
+    dib_header.image_size = bits_.size();
+    dib_header.x_pixels_per_meter = 2835;
+    dib_header.y_pixels_per_meter = 2835;
+    dib_header.colors_in_color_table = 2;
+    dib_header.important_color_count = 0;
+
+    bmp_header.signature = *reinterpret_cast<const int16_t*>("BM");
+    bmp_header.reserved1 = 0;
+    bmp_header.reserved2 = 0;
+    bmp_header.file_offset_to_pixel_array = sizeof(bmp_header) + sizeof(dib_header) + sizeof(color_table);
+    bmp_header.file_size = bmp_header.file_offset_to_pixel_array + dib_header.image_size;
+
+    stream.write(reinterpret_cast<const char*>(&bmp_header), sizeof(bmp_header));
+    stream.write(reinterpret_cast<const char*>(&dib_header), sizeof(dib_header));
+    stream.write(reinterpret_cast<const char*>(color_table), sizeof(color_table));
+    stream.write(reinterpret_cast<const char*>(bits_.data()), bits_.size());
+}
+
+void BitMask::ExportAsBMP(std::string_view file_path) const {
+    std::ofstream file(file_path.data(), std::ios_base::out | std::ios_base::binary);
+
+    if (!file.is_open()) {
+        throw AppError(AppError::OutputFileIsNotOpen);
+    }
+
+    Export(file);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Binary image packed one bit per pixel. Rows are laid out exactly like the pixel array of a
+// 1 bpp BMP (most significant bit first, padded to 4 bytes), so exporting is a single write.
+class BitMask {
+public:
+    BitMask(uint32_t width, uint32_t height)
+        : width_(width), height_(height), row_size_(GetRowSize(width)), bits_(row_size_ * height) {}
+
+    // Bytes per row of a mask `width` pixels wide.
+    static uint32_t GetRowSize(uint32_t width) {
+        return (width + 31) / 32 * 4;
+    }
+
+    uint32_t GetWidth() const {
+        return width_;
+    }
+    uint32_t GetHeight() const {
+        return height_;
+    }
+
+    bool Get(uint32_t x, uint32_t y) const {
+        return bits_[row_size_ * y + x / 8] >> (7 - x % 8) & 1;
+    }
+
+    void Set(uint32_t x, uint32_t y) {
+        bits_[row_size_ * y + x / 8] |= 1 << (7 - x % 8);
+    }
+
+    // Writes the mask as a 1 bpp BMP with a black / white color table.
+    void Export(std::ostream& stream) const;
+    void ExportAsBMP(std::string_view file_path) const;
+
+private:
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t row_size_;
+    std::vector<uint8_t> bits_;
+};
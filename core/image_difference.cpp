@@ -0,0 +1,107 @@
+#include "image_difference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "app_error.h"
+
+static constexpr uint32_t kWindowSize = 8;
+static constexpr uint32_t kWindowStep = 4;
+
+static double Channel(const Color& pixel, int channel) {
+    return channel == 0 ? pixel.R : channel == 1 ? pixel.G : pixel.B;
+}
+
+// SSIM of one window of one channel, from the means, variances and covariance of its pixels.
+static double WindowSSIM(const Bitmap& image, const Bitmap& reference, int channel, uint32_t left, uint32_t top,
+                         uint32_t width, uint32_t height) {
+    // Stabilizing constants of Wang et al. for a dynamic range of 1.
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+
+    double sum_a = 0;
+    double sum_b = 0;
+    double sum_aa = 0;
+    double sum_bb = 0;
+    double sum_ab = 0;
+    for (uint32_t y = top; y < top + height; ++y) {
+        const Color* row_a = image.GetRow(y);
+        const Color* row_b = reference.GetRow(y);
+        for (uint32_t x = left; x < left + width; ++x) {
+            double a = Channel(row_a[x], channel);
+            double b = Channel(row_b[x], channel);
+            sum_a += a;
+            sum_b += b;
+            sum_aa += a * a;
+            sum_bb += b * b;
+            sum_ab += a * b;
+        }
+    }
+
+    const double count = static_cast<double>(width) * height;
+    const double mean_a = sum_a / count;
+    const double mean_b = sum_b / count;
+    const double variance_a = sum_aa / count - mean_a * mean_a;
+    const double variance_b = sum_bb / count - mean_b * mean_b;
+    const double covariance = sum_ab / count - mean_a * mean_b;
+
+    return (2 * mean_a * mean_b + c1) * (2 * covariance + c2) /
+           ((mean_a * mean_a + mean_b * mean_b + c1) * (variance_a + variance_b + c2));
+}
+
+ImageDifference ImageDifference::Compute(const Bitmap& image, const Bitmap& reference) {
+    const uint32_t width = reference.GetWidth();
+    const uint32_t height = reference.GetHeight();
+    if (image.GetWidth() != width || image.GetHeight() != height) {
+        throw AppError(AppError::ImageSizeMismatch);
+    }
+
+    ImageDifference difference;
+    if (width == 0 || height == 0) {
+        difference.psnr = std::numeric_limits<double>::infinity();
+        return difference;
+    }
+
+    double squared_error = 0;
+    for (uint32_t y = 0; y < height; ++y) {
+        const Color* row_a = image.GetRow(y);
+        const Color* row_b = reference.GetRow(y);
+        for (uint32_t x = 0; x < width; ++x) {
+            for (int channel = 0; channel < 3; ++channel) {
+                double error = Channel(row_a[x], channel) - Channel(row_b[x], channel);
+                squared_error += error * error;
+                if (std::abs(error) > difference.max_abs_error) {
+                    difference.max_abs_error = std::abs(error);
+                    difference.max_error_x = x;
+                    difference.max_error_y = y;
+                }
+            }
+        }
+    }
+    difference.mean_squared_error = squared_error / (3.0 * width * height);
+    difference.psnr = difference.mean_squared_error > 0 ? -10 * std::log10(difference.mean_squared_error)
+                                                        : std::numeric_limits<double>::infinity();
+
+    // Images smaller than a window make a single window of their own size.
+    const uint32_t window_width = std::min(width, kWindowSize);
+    const uint32_t window_height = std::min(height, kWindowSize);
+    double ssim_sum = 0;
+    uint64_t windows = 0;
+    for (uint32_t top = 0; top + window_height <= height; top += kWindowStep) {
+        for (uint32_t left = 0; left + window_width <= width; left += kWindowStep) {
+            for (int channel = 0; channel < 3; ++channel) {
+                ssim_sum += WindowSSIM(image, reference, channel, left, top, window_width, window_height);
+            }
+            windows += 3;
+        }
+    }
+    difference.ssim = ssim_sum / windows;
+
+    return difference;
+}
+
+void ImageDifference::Report(std::ostream& stream) const {
+    stream << "max abs error " << max_abs_error << " at (" << max_error_x << ", " << max_error_y << "), MSE "
+           << mean_squared_error << ", PSNR " << psnr << " dB, SSIM " << ssim;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#include "bitmap.h"
+
+// How far an image is from a reference of the same size, over the visible pixels and all three
+// channels, for checking approximate fast paths against the exact double implementation.
+struct ImageDifference {
+    // Largest difference of a single channel, 0 to 1, and the pixel where it is.
+    double max_abs_error = 0;
+    uint32_t max_error_x = 0;
+    uint32_t max_error_y = 0;
+    double mean_squared_error = 0;
+    // Peak signal-to-noise ratio in dB for a peak of 1, infinite for equal images.
+    double psnr = 0;
+    // Mean structural similarity of 8x8 windows, 4 pixels apart, averaged over the channels:
+    // 1 for equal images, falling towards 0 as local contrast and structure differ.
+    double ssim = 1;
+
+    // Throws ImageSizeMismatch if the images have different sizes.
+    static ImageDifference Compute(const Bitmap& image, const Bitmap& reference);
+
+    void Report(std::ostream& stream) const;
+};
@@ -0,0 +1,167 @@
+#include "image_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "app_error.h"
+
+// Mixes x into a well distributed 64-bit value (splitmix64 finalizer); pixels are hashed by
+// position rather than drawn in sequence, so every row renders on its own.
+static uint64_t Mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Scales position to 0..255 over length; single pixel sides stay black.
+static uint8_t Ramp(uint64_t position, uint64_t length) {
+    return length > 1 ? position * 255 / (length - 1) : 0;
+}
+
+ImageGenerator::ImageGenerator(uint32_t width, uint32_t height, Pattern pattern, uint64_t seed)
+    : width_(width), height_(height), pattern_(pattern), seed_(seed) {
+    if (width_ == 0 || height_ == 0) {
+        throw AppError(AppError::InvalidOptionValue);
+    }
+}
+
+ImageGenerator::Pattern ImageGenerator::ParsePattern(std::string_view name) {
+    if (name == "noise") {
+        return Pattern::Noise;
+    }
+    if (name == "gradient") {
+        return Pattern::Gradient;
+    }
+    if (name == "checkerboard") {
+        return Pattern::Checkerboard;
+    }
+    if (name == "edges") {
+        return Pattern::Edges;
+    }
+    throw AppError(AppError::InvalidOptionValue);
+}
+
+void ImageGenerator::RenderRow(uint32_t y, uint8_t* row) const {
+    switch (pattern_) {
+        case Pattern::Noise: {
+            uint64_t row_seed = Mix(seed_ ^ Mix(y));
+            for (uint32_t x = 0; x < width_; ++x) {
+                uint64_t bits = Mix(row_seed + x);
+                row[3 * x] = bits;
+                row[3 * x + 1] = bits >> 8;
+                row[3 * x + 2] = bits >> 16;
+            }
+            break;
+        }
+        case Pattern::Gradient: {
+            uint8_t green = Ramp(y, height_);
+            for (uint32_t x = 0; x < width_; ++x) {
+                row[3 * x] = Ramp(uint64_t{x} + y, uint64_t{width_} + height_ - 1);
+                row[3 * x + 1] = green;
+                row[3 * x + 2] = Ramp(x, width_);
+            }
+            break;
+        }
+        case Pattern::Checkerboard: {
+            for (uint32_t x = 0; x < width_; ++x) {
+                uint8_t value = (x / kCellSize + y / kCellSize) % 2 == 0 ? 255 : 0;
+                row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = value;
+            }
+            break;
+        }
+        case Pattern::Edges: {
+            double dy = y + 0.5 - height_ / 2.0;
+            for (uint32_t x = 0; x < width_; ++x) {
+                double dx = x + 0.5 - width_ / 2.0;
+                uint64_t ring = std::sqrt(dx * dx + dy * dy) / kCellSize;
+                uint8_t value = ring % 2 == 0 ? 255 : 0;
+                row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = value;
+            }
+            break;
+        }
+    }
+}
+
+void ImageGenerator::Write(std::ostream& stream, uint32_t bits_per_pixel) const {
+    if (bits_per_pixel != 24 && bits_per_pixel != 1) {
+        throw AppError(AppError::InvalidOptionValue);
+    }
+
+    const uint8_t color_table[] = {0, 0, 0, 0, 255, 255, 255, 0};
+    const size_t color_table_size = bits_per_pixel == 1 ? sizeof(color_table) : 0;
+
+    uint64_t row_size = (uint64_t{width_} * bits_per_pixel + 31) / 32 * 4;
+    uint64_t image_size = row_size * height_;
+    uint64_t pixel_array_offset = sizeof(Bitmap::BMPHeader) + sizeof(Bitmap::DIBHeader) + color_table_size;
+    if (pixel_array_offset + image_size > UINT32_MAX) {
+        throw AppError(AppError::InvalidOptionValue);
+    }
+
+    Bitmap::BMPHeader bmp_header;
+    Bitmap::DIBHeader dib_header;
+
+    dib_header.dib_header_size = sizeof(dib_header);
+    dib_header.image_width = width_;
+    dib_header.image_height = height_;
+    dib_header.planes = 1;
+    dib_header.bits_per_pixel = bits_per_pixel;
+    dib_header.compression = 0;
+    dib_header.image_size = image_size;
+    dib_header.x_pixels_per_meter = 2835;
+    dib_header.y_pixels_per_meter = 2835;
+    dib_header.colors_in_color_table = bits_per_pixel == 1 ? 2 : 0;
+    dib_header.important_color_count = 0;
+
+    bmp_header.signature = *reinterpret_cast<const int16_t*>("BM");
+    bmp_header.reserved1 = 0;
+    bmp_header.reserved2 = 0;
+    bmp_header.file_offset_to_pixel_array = pixel_array_offset;
+    bmp_header.file_size = pixel_array_offset + image_size;
+
+    stream.write(reinterpret_cast<const char*>(&bmp_header), sizeof(bmp_header));
+    stream.write(reinterpret_cast<const char*>(&dib_header), sizeof(dib_header));
+    stream.write(reinterpret_cast<const char*>(color_table), color_table_size);
+
+    std::vector<uint8_t> pixels(uint64_t{width_} * 3);
+    std::vector<uint8_t> row(row_size, 0);
+    for (uint32_t y = 0; y < height_; ++y) {
+        if (bits_per_pixel == 24) {
+            RenderRow(y, row.data());
+        } else {
+            RenderRow(y, pixels.data());
+            std::fill(row.begin(), row.end(), 0);
+            for (uint32_t x = 0; x < width_; ++x) {
+                const uint8_t* pixel = pixels.data() + 3 * x;
+                // Integer Rec. 601 luma, the weights of -gs.
+                uint32_t luma = (114 * pixel[0] + 587 * pixel[1] + 299 * pixel[2]) / 1000;
+                if (luma >= 128) {
+                    row[x / 8] |= 0x80 >> (x % 8);
+                }
+            }
+        }
+        stream.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+}
+
+void ImageGenerator::WriteToFile(std::string_view file_path, uint32_t bits_per_pixel) const {
+    std::ofstream file(file_path.data(), std::ios_base::out | std::ios_base::binary);
+
+    if (!file.is_open()) {
+        throw AppError(AppError::OutputFileIsNotOpen);
+    }
+
+    Write(file, bits_per_pixel);
+}
+
+Bitmap ImageGenerator::Generate() const {
+    std::stringstream stream(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    Write(stream);
+
+    Bitmap image;
+    image.Load(stream);
+    return image;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#include "bitmap.h"
+
+// Synthetic images that are the same for the same arguments on every machine, for tests and
+// benchmarks that should not depend on stored files. Images are written row by row, so one of
+// any size takes no more memory than a row and a multi-gigabyte BMP is written at disk speed.
+class ImageGenerator {
+public:
+    enum class Pattern {
+        // Independent random channels, seeded.
+        Noise,
+        // Red rising to the right, green to the bottom and blue along the diagonal.
+        Gradient,
+        // Black and white squares of kCellSize pixels.
+        Checkerboard,
+        // Concentric rings of kCellSize pixels around the center, hard edges in every direction.
+        Edges,
+    };
+
+    static constexpr uint32_t kCellSize = 16;
+
+    ImageGenerator(uint32_t width, uint32_t height, Pattern pattern, uint64_t seed = 0);
+
+    // Pattern by its command line name: noise, gradient, checkerboard or edges.
+    static Pattern ParsePattern(std::string_view name);
+
+    // Writes a BMP file with 24 or 1 bits per pixel; at 1 bit, pixels are thresholded at mid-gray.
+    void Write(std::ostream& stream, uint32_t bits_per_pixel = 24) const;
+    void WriteToFile(std::string_view file_path, uint32_t bits_per_pixel = 24) const;
+
+    // The 24-bit image, decoded.
+    Bitmap Generate() const;
+
+private:
+    // Blue, green and red bytes of every pixel of row y, as stored in a 24-bit BMP.
+    void RenderRow(uint32_t y, uint8_t* row) const;
+
+    uint32_t width_;
+    uint32_t height_;
+    Pattern pattern_;
+    uint64_t seed_;
+};
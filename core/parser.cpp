@@ -2,40 +2,71 @@
 
 #include "app_error.h"
 
-FiltersParser::FiltersParser(int argc, const char** argv) : argc_(argc - 1), argv_(argv + 1) {
-    if (argc_ < 2) {
+static bool IsFilterName(std::string_view arg) {
+    return arg.size() > 1 && arg[0] == '-';
+}
+
+FiltersParser::FiltersParser(int argc, const char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+
+        if (arg.substr(0, 2) != "--") {
+            args_.push_back(argv[i]);
+            continue;
+        }
+
+        size_t value_pos = arg.find('=');
+        if (value_pos == std::string_view::npos) {
+            options_[arg.substr(2)] = std::string_view();
+        } else {
+            options_[arg.substr(2, value_pos - 2)] = arg.substr(value_pos + 1);
+        }
+    }
+
+    argc_ = static_cast<int>(args_.size());
+    argv_ = args_.data();
+
+    auto batch = options_.find("batch");
+    bool batch_list = batch != options_.end() && !batch->second.empty();
+    if (batch_list || options_.count("serve")) {
+        path_count_ = 0;
+    } else if (options_.count("generate")) {
+        path_count_ = 1;
+    } else {
+        path_count_ = 2;
+    }
+
+    // --explain only prints the plan, so the paths may be left out.
+    if (options_.count("explain") && (argc_ == 0 || IsFilterName(argv_[0]))) {
+        path_count_ = 0;
+    }
+
+    if (argc_ < path_count_) {
         throw AppError(AppError::NotEnoughFileEntries);
     }
 }
 
 std::vector<FilterInfo> FiltersParser::ParseFilters() {
-    int filters_argc = argc_ - 2;
+    int filters_argc = argc_ - path_count_;
     const char** filters_argv = nullptr;
     if (filters_argc > 0) {
-        filters_argv = &argv_[2];
+        filters_argv = &argv_[path_count_];
     }
 
     std::vector<FilterInfo> filters_info;
-    FilterInfo* current_filter = nullptr;
 
     for (int i = 0; i < filters_argc; ++i) {
         std::string_view arg = filters_argv[i];
 
         if (arg[0] == '-') {
-            if (current_filter) {
-                filters_info.push_back(*current_filter);
-            }
-            current_filter = new FilterInfo(arg.substr(1, arg.size() - 1));
+            filters_info.emplace_back(arg.substr(1, arg.size() - 1));
         } else {
-            if (!current_filter) {
+            if (filters_info.empty()) {
                 throw AppError(AppError::FilterNameNotSpecified);
             }
-            current_filter->AddParam(arg);
+            filters_info.back().AddParam(arg);
         }
     }
-    if (current_filter) {
-        filters_info.push_back(*current_filter);
-    }
 
     return filters_info;
 }
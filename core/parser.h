@@ -3,6 +3,7 @@
 #include <string_view>
 #include <vector>
 #include <tuple>
+#include <map>
 
 class FilterInfo {
 public:
@@ -30,19 +31,35 @@ private:
 
 class FiltersParser {
 public:
+    using Options = std::map<std::string_view, std::string_view>;
+
     FiltersParser(int argc, const char* argv[]);
 
+    // False with --batch=<list> and --serve, where files are named by the list or the requests,
+    // and with --explain when the filters come first. With --generate there is an output path only.
+    bool HasPaths() const {
+        return path_count_ > 0;
+    }
+
     std::string_view ParseInputPath() const {
         return static_cast<std::string_view>(argv_[0]);
     }
 
     std::string_view ParseOutputPath() const {
-        return static_cast<std::string_view>(argv_[1]);
+        return static_cast<std::string_view>(argv_[path_count_ - 1]);
     }
 
     std::vector<FilterInfo> ParseFilters();
 
+    // Options are --name or --name=value arguments, accepted anywhere on the command line.
+    const Options& ParseOptions() const {
+        return options_;
+    }
+
 private:
     int argc_;
     const char** argv_;
+    int path_count_;
+    std::vector<const char*> args_;
+    Options options_;
 };
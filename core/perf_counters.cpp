@@ -0,0 +1,97 @@
+#include "perf_counters.h"
+
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Counter group of one thread, led by the cycle counter so that all events count over the same
+// intervals and are read with a single system call.
+class PerfEventGroup {
+public:
+    static constexpr int kEventCount = 4;
+
+    PerfEventGroup() {
+#ifdef __linux__
+        static const uint64_t kEvents[kEventCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int event = 0; event < kEventCount; ++event) {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = kEvents[event];
+            attributes.read_format = PERF_FORMAT_GROUP;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, leader_, 0));
+            if (fd < 0) {
+                if (leader_ < 0) {
+                    return;
+                }
+                continue;
+            }
+            if (leader_ < 0) {
+                leader_ = fd;
+            }
+            fds_[open_count_] = fd;
+            slots_[event] = open_count_++;
+        }
+#endif
+    }
+
+    PerfEventGroup(const PerfEventGroup&) = delete;
+    PerfEventGroup& operator=(const PerfEventGroup&) = delete;
+
+    ~PerfEventGroup() {
+#ifdef __linux__
+        for (int i = 0; i < open_count_; ++i) {
+            close(fds_[i]);
+        }
+#endif
+    }
+
+    bool IsOpen() const {
+        return leader_ >= 0;
+    }
+
+    HardwareCounts Read() const {
+        HardwareCounts counts;
+#ifdef __linux__
+        // PERF_FORMAT_GROUP: the number of events, then their values in the order they were opened.
+        uint64_t values[1 + kEventCount] = {};
+        if (leader_ < 0 || read(leader_, values, sizeof(values)) <= 0) {
+            return counts;
+        }
+        auto value = [&](int event) { return slots_[event] < 0 ? 0 : values[1 + slots_[event]]; };
+        counts.cycles = value(0);
+        counts.instructions = value(1);
+        counts.cache_misses = value(2);
+        counts.branch_misses = value(3);
+#endif
+        return counts;
+    }
+
+private:
+    int leader_ = -1;
+    int fds_[kEventCount] = {};
+    int slots_[kEventCount] = {-1, -1, -1, -1};
+    int open_count_ = 0;
+};
+
+static PerfEventGroup& GetThreadGroup() {
+    thread_local PerfEventGroup counters;
+    return counters;
+}
+
+bool PerfCounters::IsAvailable() {
+    return GetThreadGroup().IsOpen();
+}
+
+HardwareCounts PerfCounters::Read() {
+    return GetThreadGroup().Read();
+}
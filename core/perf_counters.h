@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+// Event counts of a thread; differences of two reads give the events in between.
+struct HardwareCounts {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branch_misses = 0;
+
+    HardwareCounts& operator+=(const HardwareCounts& other) {
+        cycles += other.cycles;
+        instructions += other.instructions;
+        cache_misses += other.cache_misses;
+        branch_misses += other.branch_misses;
+        return *this;
+    }
+    HardwareCounts& operator-=(const HardwareCounts& other) {
+        cycles -= other.cycles;
+        instructions -= other.instructions;
+        cache_misses -= other.cache_misses;
+        branch_misses -= other.branch_misses;
+        return *this;
+    }
+};
+
+// Hardware performance counters of the calling thread through perf_event_open: cycles,
+// instructions, last level cache misses and branch misses, in user space only. Each thread opens
+// its own group of counters on first use and closes it when it exits. Where the kernel refuses
+// them (no PMU in a VM, perf_event_paranoid, seccomp) the counts stay zero, and so does a single
+// event the CPU does not have.
+class PerfCounters {
+public:
+    // Whether the calling thread could open its cycle counter.
+    static bool IsAvailable();
+
+    static HardwareCounts Read();
+};
@@ -0,0 +1,233 @@
+#include "result_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "hash.h"
+#include "app_error.h"
+
+namespace fs = std::filesystem;
+
+// Marks the temporary files of entries being written, after the entry's own name.
+static constexpr std::string_view kTemporarySuffix = ".tmp";
+// A temporary file not renamed into an entry for this long was left by a process that died.
+static constexpr auto kStaleTemporaryAge = std::chrono::hours(1);
+
+struct ResultCache::Entry {
+    fs::path path;
+    uint64_t size;
+    fs::file_time_type last_use;
+};
+
+// Makes `to` a copy of `from`, sharing its blocks if the file system supports reflinks.
+static bool CloneFile(const std::string& from, const std::string& to) {
+#ifdef FICLONE
+    int source = open(from.c_str(), O_RDONLY);
+    if (source >= 0) {
+        int target = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool cloned = target >= 0 && ioctl(target, FICLONE, source) == 0;
+        if (target >= 0) {
+            close(target);
+        }
+        close(source);
+        if (cloned) {
+            return true;
+        }
+    }
+#endif
+
+    std::error_code error;
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, error);
+    return !error;
+}
+
+ResultCache::ResultCache(std::string_view directory, uint64_t size_limit, std::string_view extension)
+    : directory_(directory), size_limit_(size_limit), extension_(extension) {
+    std::error_code error;
+    fs::create_directories(directory_, error);
+    if (error || !fs::is_directory(directory_)) {
+        throw AppError(AppError::CacheDirectoryError);
+    }
+
+    ScanEntries(total_size_);
+}
+
+std::string ResultCache::MakeKey(std::string_view input, std::string_view plan) {
+    return FormatKey(Hash64::Compute(input, Hash64::Compute(plan)), input.size());
+}
+
+std::string ResultCache::FormatKey(uint64_t hash, uint64_t size) {
+    static const char kDigits[] = "0123456789abcdef";
+
+    std::string key(16, '0');
+    for (size_t i = key.size(); i-- > 0; hash >>= 4) {
+        key[i] = kDigits[hash & 15];
+    }
+    return key + "-" + std::to_string(size);
+}
+
+std::string ResultCache::GetEntryPath(const std::string& key) const {
+    return (fs::path(directory_) / (key + extension_)).string();
+}
+
+std::string ResultCache::Lookup(const std::string& key) {
+    const std::string entry_path = GetEntryPath(key);
+
+    std::error_code error;
+    if (!fs::is_regular_file(entry_path, error)) {
+        return std::string();
+    }
+
+    fs::last_write_time(entry_path, fs::file_time_type::clock::now(), error);
+    return entry_path;
+}
+
+std::string ResultCache::Find(const std::string& key) {
+    std::string entry_path = Lookup(key);
+    ++(entry_path.empty() ? misses_ : hits_);
+    return entry_path;
+}
+
+std::string ResultCache::CreateTemporaryFile(const std::string& key) const {
+    // Written under a temporary name first, so other readers never see a partial entry.
+    std::string path = GetEntryPath(key) + std::string(kTemporarySuffix) + "XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        return std::string();
+    }
+    // Entries are as readable as any other output file.
+    fchmod(fd, 0644);
+    close(fd);
+    return path;
+}
+
+void ResultCache::Insert(const std::string& key, const std::string& temporary_path) {
+    const std::string entry_path = GetEntryPath(key);
+
+    std::error_code error;
+    const uint64_t size = fs::file_size(temporary_path, error);
+    if (error || size > size_limit_) {
+        fs::remove(temporary_path, error);
+        return;
+    }
+    std::error_code replaced_error;
+    uint64_t replaced_size = fs::file_size(entry_path, replaced_error);
+    if (replaced_error) {
+        replaced_size = 0;
+    }
+
+    fs::rename(temporary_path, entry_path, error);
+    if (error) {
+        fs::remove(temporary_path, error);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(size_mutex_);
+    total_size_ += size;
+    total_size_ -= std::min(total_size_, replaced_size);
+    if (total_size_ > size_limit_) {
+        Evict();
+    }
+}
+
+bool ResultCache::Fetch(const std::string& key, const std::string& output_path) {
+    // The entry may be evicted by another process between the lookup and the copy.
+    const std::string entry_path = Lookup(key);
+    if (entry_path.empty() || !CloneFile(entry_path, output_path)) {
+        ++misses_;
+        return false;
+    }
+    ++hits_;
+    return true;
+}
+
+void ResultCache::Store(const std::string& key, const std::string& output_path) {
+    const std::string temporary_path = CreateTemporaryFile(key);
+    if (temporary_path.empty()) {
+        return;
+    }
+    if (!CloneFile(output_path, temporary_path)) {
+        std::error_code error;
+        fs::remove(temporary_path, error);
+        return;
+    }
+
+    Insert(key, temporary_path);
+}
+
+std::vector<ResultCache::Entry> ResultCache::ScanEntries(uint64_t& total_size) const {
+    const auto stale_before = fs::file_time_type::clock::now() - kStaleTemporaryAge;
+
+    std::error_code error;
+    std::vector<Entry> entries;
+    total_size = 0;
+    for (const auto& file : fs::directory_iterator(directory_, error)) {
+        // Other processes may remove files meanwhile, so every query may fail on its own.
+        std::error_code size_error;
+        std::error_code time_error;
+        const std::string name = file.path().filename().string();
+        if (name.find(std::string(extension_) + std::string(kTemporarySuffix)) != std::string::npos) {
+            auto last_write = file.last_write_time(time_error);
+            if (!time_error && last_write < stale_before) {
+                fs::remove(file.path(), error);
+            }
+            continue;
+        }
+        if (file.path().extension() != extension_) {
+            continue;
+        }
+
+        Entry entry{file.path(), file.file_size(size_error), {}};
+        if (size_error) {
+            continue;
+        }
+        entry.last_use = file.last_write_time(time_error);
+        if (time_error) {
+            continue;
+        }
+        total_size += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+void ResultCache::Evict() {
+    // Other processes sharing the directory may have stored or evicted entries since the last scan.
+    std::vector<Entry> entries = ScanEntries(total_size_);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.last_use < rhs.last_use;
+    });
+
+    std::error_code error;
+    for (const auto& entry : entries) {
+        if (total_size_ <= size_limit_) {
+            break;
+        }
+        if (fs::remove(entry.path, error)) {
+            total_size_ -= entry.size;
+            ++evictions_;
+        }
+    }
+}
+
+ResultCache::Stats ResultCache::GetStats() const {
+    return Stats{hits_, misses_, evictions_};
+}
+
+void ResultCache::ReportStats(std::ostream& stream, std::string_view title) const {
+    Stats stats = GetStats();
+    stream << title << ": " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions"
+           << std::endl;
+}
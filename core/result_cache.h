@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// On-disk cache of output files, content-addressed by the input file and the plan that ran on it.
+// A hit is served by cloning (reflinking) or copying the cached file, without decoding anything.
+// Entries are plain files of the cache directory, so several processes may share it; recency is
+// kept in their modification time and the least recently used ones are evicted once the
+// directory outgrows its size limit. The size of the directory is scanned when the cache is opened
+// and then kept up to date by every store, so that only a store crossing the limit scans again.
+// Pipeline checkpoints are kept the same way, in a cache of their own with the ".raw" extension.
+class ResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    // Creates `directory` if missing. Only files with `extension` are entries of the cache.
+    ResultCache(std::string_view directory, uint64_t size_limit, std::string_view extension = ".bmp");
+
+    // Key of the output of `plan` on a file with the bytes `input`. The plan has to name everything
+    // the output depends on, output format included.
+    static std::string MakeKey(std::string_view input, std::string_view plan);
+
+    // Key made of a hash of the content and its size.
+    static std::string FormatKey(uint64_t hash, uint64_t size);
+
+    // Writes the cached output of `key` to output_path and returns true, or returns false on a miss.
+    bool Fetch(const std::string& key, const std::string& output_path);
+
+    // Stores the file at output_path as the output of `key`, then evicts least recently used
+    // entries until the cache fits in its limit. Failing to store is not an error.
+    void Store(const std::string& key, const std::string& output_path);
+
+    // Lower level access for entries that are not copied around as files. Find returns the path of
+    // the entry of `key`, marking it used, or an empty string on a miss. A new entry is written to
+    // a file made by CreateTemporaryFile(key), unique to the caller even across processes, and
+    // then moved into the cache by Insert. CreateTemporaryFile returns an empty string on failure.
+    // An entry larger than the whole limit is dropped rather than evicting everything else.
+    std::string Find(const std::string& key);
+    std::string CreateTemporaryFile(const std::string& key) const;
+    void Insert(const std::string& key, const std::string& temporary_path);
+
+    uint64_t GetSizeLimit() const {
+        return size_limit_;
+    }
+
+    Stats GetStats() const;
+
+    void ReportStats(std::ostream& stream, std::string_view title = "Cache") const;
+
+private:
+    std::string GetEntryPath(const std::string& key) const;
+
+    // Path of the entry of `key`, marked as used, or an empty string.
+    std::string Lookup(const std::string& key);
+
+    // Entries of the directory with their total size. Removes temporary files that a crashed
+    // process left behind along the way.
+    struct Entry;
+    std::vector<Entry> ScanEntries(uint64_t& total_size) const;
+
+    // Removes least recently used entries until the cache fits in its limit. Called with
+    // size_mutex_ held.
+    void Evict();
+
+    std::string directory_;
+    uint64_t size_limit_;
+    std::string extension_;
+
+    // Bytes of the entries as of the last scan plus what this process stored since.
+    std::mutex size_mutex_;
+    uint64_t total_size_ = 0;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+    std::atomic<uint64_t> evictions_ = 0;
+};
@@ -0,0 +1,358 @@
+#include "server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "utils.h"
+#include "filter_pipeline.h"
+#include "app_error.h"
+
+using namespace std::string_view_literals;
+
+// Longest request line accepted, so that a client can't make the server buffer without end.
+static constexpr size_t kMaxLineSize = 64 * 1024;
+// Largest inline input accepted.
+static constexpr uint32_t kMaxInlineSize = 1u << 30;
+
+// Responses are one line, so only the first line of a message is sent.
+static std::string ErrorResponse(std::string_view message) {
+    return "ERROR " + std::string(message.substr(0, message.find('\n'))) + "\n";
+}
+
+// Buffered reads and whole writes on a connected socket.
+class Server::Connection {
+public:
+    explicit Connection(int fd) : fd_(fd) {}
+
+    // Reads up to the next newline, which is dropped. False once the peer is gone.
+    bool ReadLine(std::string& line) {
+        line.clear();
+        while (true) {
+            size_t end = buffer_.find('\n', position_);
+            if (end != std::string::npos) {
+                line.append(buffer_, position_, end - position_);
+                position_ = end + 1;
+                return true;
+            }
+
+            line.append(buffer_, position_);
+            position_ = buffer_.size();
+            if (line.size() > kMaxLineSize || !Fill()) {
+                return false;
+            }
+        }
+    }
+
+    bool Read(char* data, size_t size) {
+        while (size > 0) {
+            if (position_ == buffer_.size() && !Fill()) {
+                return false;
+            }
+            size_t chunk = std::min(size, buffer_.size() - position_);
+            std::memcpy(data, buffer_.data() + position_, chunk);
+            position_ += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    bool Write(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t written = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
+private:
+    // Replaces the consumed buffer with the next bytes from the socket.
+    bool Fill() {
+        char chunk[64 * 1024];
+        ssize_t size = 0;
+        do {
+            size = recv(fd_, chunk, sizeof(chunk), 0);
+        } while (size < 0 && errno == EINTR);
+
+        if (size <= 0) {
+            return false;
+        }
+        buffer_.assign(chunk, size);
+        position_ = 0;
+        return true;
+    }
+
+    int fd_;
+    std::string buffer_;
+    size_t position_ = 0;
+};
+
+Server::Server(std::string_view socket_path, size_t threads, size_t memory_limit)
+    : socket_path_(socket_path),
+      listen_fd_(socket(AF_UNIX, SOCK_STREAM, 0)),
+      scheduler_(std::max<size_t>(1, threads)),
+      admission_(memory_limit, scheduler_.GetThreadCount()) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (listen_fd_ < 0) {
+        throw AppError(AppError::ServerSocketError);
+    }
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        close(listen_fd_);
+        throw AppError(AppError::ServerSocketError);
+    }
+    socket_path_.copy(address.sun_path, socket_path_.size());
+
+    // Only a socket, left by a server that did not shut down cleanly, is replaced.
+    struct stat status;
+    if (lstat(socket_path_.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            close(listen_fd_);
+            throw AppError(AppError::ServerSocketPathTaken);
+        }
+        unlink(socket_path_.c_str());
+    }
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, SOMAXCONN) != 0) {
+        close(listen_fd_);
+        throw AppError(AppError::ServerSocketError);
+    }
+}
+
+void Server::Run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(connections_mutex_);
+            connection_closed_.wait(lock, [this] { return stopping_ || connections_.size() < kMaxConnections; });
+        }
+        JoinFinishedThreads();
+
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            if (stopping_) {
+                close(fd);
+                break;
+            }
+            connections_.insert(fd);
+        }
+
+        std::thread thread(&Server::ServeConnection, this, fd);
+        threads_.emplace(thread.get_id(), std::move(thread));
+    }
+
+    for (auto& [id, thread] : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+void Server::Stop() {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    stopping_ = true;
+    shutdown(listen_fd_, SHUT_RDWR);
+    for (int fd : connections_) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    connection_closed_.notify_all();
+}
+
+void Server::JoinFinishedThreads() {
+    std::vector<std::thread::id> finished;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        finished.swap(finished_threads_);
+    }
+
+    for (const auto& id : finished) {
+        threads_[id].join();
+        threads_.erase(id);
+    }
+}
+
+void Server::ServeConnection(int fd) {
+    Connection connection(fd);
+    std::string line;
+    while (connection.ReadLine(line) && connection.Write(HandleRequest(line, connection))) {
+    }
+
+    // Stop only shuts down sockets still in the set, so the number can't be reused under it.
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    connections_.erase(fd);
+    close(fd);
+    finished_threads_.push_back(std::this_thread::get_id());
+    connection_closed_.notify_all();
+}
+
+std::string Server::HandleRequest(const std::string& line, Connection& connection) {
+    // FiltersParser takes the arguments the way main does, program name first.
+    std::vector<std::string> tokens = {"bmp_processor"};
+    std::istringstream line_stream(line);
+    for (std::string token; line_stream >> token;) {
+        tokens.push_back(std::move(token));
+    }
+
+    std::vector<const char*> argv;
+    for (const auto& token : tokens) {
+        argv.push_back(token.c_str());
+    }
+
+    // The input is the first argument that is not an option, wherever the options are. A line
+    // without paths names no input, and so can't be followed by one.
+    std::unique_ptr<FiltersParser> parser;
+    try {
+        parser.reset(new FiltersParser(static_cast<int>(argv.size()), argv.data()));
+    } catch (const AppError& e) {
+        return ErrorResponse(e.GetMessage());
+    }
+
+    // An inline input is read before anything else can fail, so the connection stays in step.
+    std::string inline_input;
+    if (parser->HasPaths() && parser->ParseInputPath() == "-"sv) {
+        char header[6];
+        uint32_t file_size = 0;
+        if (connection.Read(header, sizeof(header))) {
+            std::memcpy(&file_size, header + 2, sizeof(file_size));
+        }
+        if (file_size < sizeof(header) || file_size > kMaxInlineSize) {
+            return ErrorResponse(AppError(AppError::InlineInputError).GetMessage());
+        }
+        inline_input.resize(file_size);
+        std::memcpy(inline_input.data(), header, sizeof(header));
+        if (!connection.Read(inline_input.data() + sizeof(header), file_size - sizeof(header))) {
+            return ErrorResponse(AppError(AppError::InlineInputError).GetMessage());
+        }
+    }
+
+    std::unique_ptr<Workspace> workspace;
+    size_t admitted_bytes = 0;
+    bool admitted = false;
+    std::string response;
+    try {
+        std::vector<FilterInfo> parsed_filters = parser->ParseFilters();
+
+        uint32_t bits_per_pixel = 24;
+        PipelineOptions pipeline_options;
+        pipeline_options.scheduler = &scheduler_;
+        for (const auto& [name, value] : parser->ParseOptions()) {
+            if (name == "bpp"sv) {
+                bits_per_pixel = SVToType<uint32_t>(value);
+                if (bits_per_pixel != 24 && bits_per_pixel != 1) {
+                    throw AppError(AppError::InvalidOptionValue);
+                }
+            } else if (name == "optimize"sv) {
+                pipeline_options.optimize = true;
+            } else if (name == "tiled"sv) {
+                pipeline_options.tiled = true;
+            } else {
+                throw AppError(AppError::UnknownOption);
+            }
+        }
+
+        FiltersPipeline pipeline(parsed_filters, pipeline_options);
+
+        const bool is_inline = parser->ParseInputPath() == "-"sv;
+        std::istringstream inline_stream(std::move(inline_input));
+        std::ifstream file;
+        if (!is_inline) {
+            file.open(std::string(parser->ParseInputPath()), std::ios_base::in | std::ios_base::binary);
+            if (!file.is_open()) {
+                throw AppError(AppError::InputFileIsNotOpen);
+            }
+        }
+        std::istream& input = is_inline ? static_cast<std::istream&>(inline_stream) : file;
+
+        // Only a header that fits its file gets this far, so the estimate bounds what Load takes.
+        const Bitmap::DIBHeader header = Bitmap::ReadDIBHeader(input);
+        input.seekg(0);
+        admitted_bytes = pipeline.EstimateMemory(header.image_width, header.image_height, bits_per_pixel);
+        {
+            std::unique_lock<std::mutex> lock(admission_mutex_);
+            admission_changed_.wait(lock, [&] { return admission_.CanAdmit(admitted_bytes); });
+            admission_.Admit(admitted_bytes);
+            admitted = true;
+        }
+
+        workspace = AcquireWorkspace();
+        workspace->bytes = std::max(workspace->bytes, admitted_bytes);
+        Bitmap& image = workspace->image;
+        image.Load(input);
+
+        std::ostringstream output;
+        const bool send_output = parser->ParseOutputPath() == "-"sv;
+        if (bits_per_pixel == 1) {
+            BitMask mask = pipeline.ApplyAsMask(image, workspace->context);
+            send_output ? mask.Export(output) : mask.ExportAsBMP(parser->ParseOutputPath());
+        } else {
+            pipeline.Apply(image, workspace->context);
+            send_output ? image.Export(output) : image.ExportAsBMP(parser->ParseOutputPath());
+        }
+
+        if (send_output) {
+            response = "OK " + std::to_string(output.str().size()) + "\n" + output.str();
+        } else {
+            response = "OK\n";
+        }
+    } catch (const AppError& e) {
+        response = ErrorResponse(e.GetMessage());
+    } catch (const std::exception& e) {
+        response = ErrorResponse(e.what());
+    }
+
+    if (workspace) {
+        ReleaseWorkspace(std::move(workspace));
+    }
+    if (admitted) {
+        std::lock_guard<std::mutex> lock(admission_mutex_);
+        admission_.Release(admitted_bytes);
+        admission_changed_.notify_all();
+    }
+    return response;
+}
+
+std::unique_ptr<Server::Workspace> Server::AcquireWorkspace() {
+    std::lock_guard<std::mutex> lock(workspaces_mutex_);
+    if (workspaces_.empty()) {
+        return std::unique_ptr<Workspace>(new Workspace{Bitmap(), FilterContext(&scheduler_)});
+    }
+    std::unique_ptr<Workspace> workspace = std::move(workspaces_.back());
+    workspaces_.pop_back();
+    pooled_bytes_ -= workspace->bytes;
+    return workspace;
+}
+
+void Server::ReleaseWorkspace(std::unique_ptr<Workspace> workspace) {
+    std::lock_guard<std::mutex> lock(workspaces_mutex_);
+    // No more requests run at once than there are threads, so more workspaces are not worth
+    // keeping; one holding a huge image is freed rather than kept idle.
+    if (workspaces_.size() < scheduler_.GetThreadCount() && pooled_bytes_ + workspace->bytes <= kMaxPooledBytes) {
+        pooled_bytes_ += workspace->bytes;
+        workspaces_.push_back(std::move(workspace));
+    }
+}
+
+Server::~Server() {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
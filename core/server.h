@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+#include "bitmap.h"
+#include "filter_context.h"
+#include "task_scheduler.h"
+
+// Long-running mode that serves filter requests over a Unix domain socket, so that process start,
+// thread creation and buffer allocation are paid once rather than per image.
+//
+// A request is one line holding the arguments of a command line run:
+//     <input_file> <output_file> [--bpp=<24|1>] [--optimize] [--tiled] [<-filter_name> [filter_params]]
+// An input of "-" means the BMP file itself follows the line; an output of "-" means it is sent
+// back. The response is "OK\n", "OK <size>\n" followed by the output file, or "ERROR <message>\n".
+// A connection may send any number of requests, one after another.
+//
+// Every request runs on the same warm scheduler, with an image and a back buffer taken from a
+// pool, so a request of an already seen size allocates no pixel storage, even on a connection of
+// its own. The pool keeps one workspace per thread and kMaxPooledBytes at most. At most
+// kMaxConnections connections are served at once; further clients wait in the listen backlog.
+//
+// The input's header is checked against its size and the request's memory estimated from it
+// before any pixels are allocated. Requests then run as an AdmissionController lets them: one per
+// thread at most, and together within the memory limit, unless one runs alone.
+class Server {
+public:
+    static constexpr size_t kMaxConnections = 64;
+    static constexpr size_t kMaxPooledBytes = size_t(1) << 30;
+
+    // Listens on `socket_path`, replacing a stale socket file left there. Any other kind of file
+    // at the path is left alone and the server fails to start. A memory limit of 0 means none.
+    Server(std::string_view socket_path, size_t threads, size_t memory_limit = 0);
+
+    // Accepts and serves connections until Stop is called.
+    void Run();
+
+    // Makes Run return once the connections being served are closed. Safe to call from any thread.
+    void Stop();
+
+    ~Server();
+
+private:
+    class Connection;
+
+    struct Workspace {
+        Bitmap image;
+        FilterContext context;
+        // Largest estimate of the requests it served; its buffers never shrink.
+        size_t bytes = 0;
+    };
+
+    void ServeConnection(int fd);
+
+    // Runs one request, reading its inline input from the connection, and returns the response.
+    std::string HandleRequest(const std::string& line, Connection& connection);
+
+    void JoinFinishedThreads();
+
+    std::unique_ptr<Workspace> AcquireWorkspace();
+    void ReleaseWorkspace(std::unique_ptr<Workspace> workspace);
+
+    std::string socket_path_;
+    int listen_fd_;
+    TaskScheduler scheduler_;
+
+    std::mutex workspaces_mutex_;
+    std::vector<std::unique_ptr<Workspace>> workspaces_;
+    size_t pooled_bytes_ = 0;
+
+    std::mutex admission_mutex_;
+    std::condition_variable admission_changed_;
+    AdmissionController admission_;
+
+    // Threads serving a connection, owned by Run. A thread reports its id once done.
+    std::map<std::thread::id, std::thread> threads_;
+
+    std::mutex connections_mutex_;
+    std::condition_variable connection_closed_;
+    std::set<int> connections_;
+    std::vector<std::thread::id> finished_threads_;
+    bool stopping_ = false;
+};
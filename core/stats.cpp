@@ -0,0 +1,119 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <iomanip>
+
+void StageStats::Sample::SetUsage(const ThreadUsage& usage) {
+    cpu_seconds = usage.cpu_nanoseconds * 1e-9;
+    counts = usage.counts;
+}
+
+void StageStats::Record(const std::string& name, const Sample& sample) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stage = stages_.begin();
+    while (stage != stages_.end() && stage->name != name) {
+        ++stage;
+    }
+    if (stage == stages_.end()) {
+        stage = stages_.insert(stages_.end(), Stage{name, 0, {}});
+    }
+
+    ++stage->calls;
+    stage->total.wall_seconds += sample.wall_seconds;
+    stage->total.cpu_seconds += sample.cpu_seconds;
+    stage->total.counts += sample.counts;
+    stage->total.pixels += sample.pixels;
+    stage->total.bytes_read += sample.bytes_read;
+    stage->total.bytes_written += sample.bytes_written;
+}
+
+std::vector<StageStats::Stage> StageStats::GetStages() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stages_;
+}
+
+void WriteJsonString(std::ostream& stream, std::string_view text) {
+    static const char kDigits[] = "0123456789abcdef";
+
+    stream << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            stream << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            stream << "\\u00" << kDigits[c >> 4] << kDigits[c & 15];
+        } else {
+            stream << c;
+        }
+    }
+    stream << '"';
+}
+
+static double GetMegapixelsPerSecond(const StageStats::Sample& sample) {
+    return sample.wall_seconds > 0 ? sample.pixels * 1e-6 / sample.wall_seconds : 0;
+}
+
+static double GetInstructionsPerCycle(const HardwareCounts& counts) {
+    return counts.cycles > 0 ? static_cast<double>(counts.instructions) / counts.cycles : 0;
+}
+
+// Events per thousand pixels, comparable between images of any size.
+static double GetPerKilopixel(uint64_t events, const StageStats::Sample& sample) {
+    return sample.pixels > 0 ? events * 1e3 / sample.pixels : 0;
+}
+
+void StageStats::ReportTable(std::ostream& stream) const {
+    const auto stages = GetStages();
+
+    size_t name_width = 5;
+    for (const auto& stage : stages) {
+        name_width = std::max(name_width, stage.name.size());
+    }
+
+    stream << std::left << std::setw(static_cast<int>(name_width)) << "Stage" << std::right << std::setw(7) << "Calls"
+           << std::setw(11) << "Wall ms" << std::setw(11) << "CPU ms" << std::setw(10) << "MPixels" << std::setw(11)
+           << "MP/s" << std::setw(10) << "Read MB" << std::setw(10) << "Write MB";
+    if (hardware_counters_) {
+        stream << std::setw(11) << "Mcycles" << std::setw(7) << "IPC" << std::setw(10) << "LLC/Kpx" << std::setw(12)
+               << "BrMiss/Kpx";
+    }
+    stream << std::endl;
+    stream << std::fixed;
+    for (const auto& stage : stages) {
+        const Sample& total = stage.total;
+        stream << std::left << std::setw(static_cast<int>(name_width)) << stage.name << std::right << std::setw(7)
+               << stage.calls << std::setprecision(2) << std::setw(11) << total.wall_seconds * 1e3 << std::setw(11)
+               << total.cpu_seconds * 1e3 << std::setw(10) << total.pixels * 1e-6 << std::setprecision(1)
+               << std::setw(11) << GetMegapixelsPerSecond(total) << std::setw(10) << total.bytes_read * 1e-6
+               << std::setw(10) << total.bytes_written * 1e-6;
+        if (hardware_counters_) {
+            stream << std::setw(11) << total.counts.cycles * 1e-6 << std::setprecision(2) << std::setw(7)
+                   << GetInstructionsPerCycle(total.counts) << std::setprecision(1) << std::setw(10)
+                   << GetPerKilopixel(total.counts.cache_misses, total) << std::setw(12)
+                   << GetPerKilopixel(total.counts.branch_misses, total);
+        }
+        stream << std::endl;
+    }
+    stream << std::defaultfloat;
+}
+
+void StageStats::ReportJson(std::ostream& stream) const {
+    stream << "{\"stages\": [";
+    bool first = true;
+    for (const auto& stage : GetStages()) {
+        const Sample& total = stage.total;
+        stream << (first ? "\n" : ",\n") << "  {\"name\": ";
+        WriteJsonString(stream, stage.name);
+        stream << ", \"calls\": " << stage.calls << ", \"wall_ms\": " << total.wall_seconds * 1e3
+               << ", \"cpu_ms\": " << total.cpu_seconds * 1e3 << ", \"pixels\": " << total.pixels
+               << ", \"mpixels_per_second\": " << GetMegapixelsPerSecond(total)
+               << ", \"bytes_read\": " << total.bytes_read << ", \"bytes_written\": " << total.bytes_written;
+        if (hardware_counters_) {
+            stream << ", \"cycles\": " << total.counts.cycles << ", \"instructions\": " << total.counts.instructions
+                   << ", \"llc_misses\": " << total.counts.cache_misses
+                   << ", \"branch_misses\": " << total.counts.branch_misses;
+        }
+        stream << "}";
+        first = false;
+    }
+    stream << "\n]}" << std::endl;
+}
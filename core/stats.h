@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <time.h>
+
+#include "perf_counters.h"
+
+struct ThreadUsage;
+
+// Time and memory traffic of the stages of a run: loading, every pipeline stage and exporting,
+// each summed over all images that went through it, optionally with hardware event counts.
+// Thread-safe, so batch images running side by side record into the same stats.
+class StageStats {
+public:
+    struct Sample {
+        double wall_seconds = 0;
+        // CPU time and hardware events of every thread that worked on the stage.
+        double cpu_seconds = 0;
+        HardwareCounts counts;
+        uint64_t pixels = 0;
+        // Estimated from the number of sweeps over the image, not measured.
+        uint64_t bytes_read = 0;
+        uint64_t bytes_written = 0;
+
+        void SetUsage(const ThreadUsage& usage);
+    };
+
+    struct Stage {
+        std::string name;
+        uint64_t calls = 0;
+        Sample total;
+    };
+
+    // With hardware_counters, stages also count their events through PerfCounters.
+    explicit StageStats(bool hardware_counters = false) : hardware_counters_(hardware_counters) {}
+
+    bool HasHardwareCounters() const {
+        return hardware_counters_;
+    }
+
+    void Record(const std::string& name, const Sample& sample);
+
+    // In the order the stages were first recorded.
+    std::vector<Stage> GetStages() const;
+
+    void ReportTable(std::ostream& stream) const;
+    void ReportJson(std::ostream& stream) const;
+
+private:
+    bool hardware_counters_;
+    mutable std::mutex mutex_;
+    std::vector<Stage> stages_;
+};
+
+// Writes `text` as a quoted JSON string.
+void WriteJsonString(std::ostream& stream, std::string_view text);
+
+// CPU time consumed by the calling thread.
+inline uint64_t GetThreadCpuNanoseconds() {
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// Resources used by a thread: its CPU time and, if asked for, its hardware event counts.
+// Differences of two reads give the usage in between.
+struct ThreadUsage {
+    uint64_t cpu_nanoseconds = 0;
+    HardwareCounts counts;
+
+    static ThreadUsage Read(bool hardware_counters) {
+        ThreadUsage usage;
+        usage.cpu_nanoseconds = GetThreadCpuNanoseconds();
+        if (hardware_counters) {
+            usage.counts = PerfCounters::Read();
+        }
+        return usage;
+    }
+
+    ThreadUsage& operator+=(const ThreadUsage& other) {
+        cpu_nanoseconds += other.cpu_nanoseconds;
+        counts += other.counts;
+        return *this;
+    }
+    ThreadUsage& operator-=(const ThreadUsage& other) {
+        cpu_nanoseconds -= other.cpu_nanoseconds;
+        counts -= other.counts;
+        return *this;
+    }
+};
+
+// Measures one stage on the calling thread, from construction to Stop. The usage of other threads
+// working for the stage is added by the caller.
+class StageTimer {
+public:
+    explicit StageTimer(bool hardware_counters = false)
+        : hardware_counters_(hardware_counters),
+          start_(std::chrono::steady_clock::now()),
+          usage_start_(ThreadUsage::Read(hardware_counters)) {}
+
+    StageStats::Sample Stop(uint64_t pixels, uint64_t bytes_read, uint64_t bytes_written) const {
+        StageStats::Sample sample;
+        sample.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        ThreadUsage usage = ThreadUsage::Read(hardware_counters_);
+        usage -= usage_start_;
+        sample.SetUsage(usage);
+        sample.pixels = pixels;
+        sample.bytes_read = bytes_read;
+        sample.bytes_written = bytes_written;
+        return sample;
+    }
+
+private:
+    bool hardware_counters_;
+    std::chrono::steady_clock::time_point start_;
+    ThreadUsage usage_start_;
+};
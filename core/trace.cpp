@@ -0,0 +1,58 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+
+#include "stats.h"
+
+// Small number naming the calling thread in every trace, handed out on first use.
+static uint32_t GetTraceThread() {
+    static std::atomic<uint32_t> next_thread = 0;
+    thread_local uint32_t thread = next_thread++;
+    return thread;
+}
+
+void TraceRecorder::Record(std::string name, const char* category, Clock::time_point start, Clock::time_point end,
+                           std::string detail) {
+    using Microseconds = std::chrono::duration<double, std::micro>;
+
+    Event event{std::move(name),
+                category,
+                Microseconds(start - start_).count(),
+                Microseconds(end - start).count(),
+                GetTraceThread(),
+                std::move(detail)};
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+}
+
+void TraceRecorder::Write(std::ostream& stream) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<uint32_t> threads;
+    stream << "{\"traceEvents\": [" << std::fixed << std::setprecision(3);
+    for (const auto& event : events_) {
+        stream << "\n  {\"name\": ";
+        WriteJsonString(stream, event.name);
+        stream << ", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"ts\": " << event.start_microseconds
+               << ", \"dur\": " << event.duration_microseconds << ", \"pid\": 1, \"tid\": " << event.thread;
+        if (!event.detail.empty()) {
+            stream << ", \"args\": {\"detail\": ";
+            WriteJsonString(stream, event.detail);
+            stream << "}";
+        }
+        stream << "},";
+
+        if (std::find(threads.begin(), threads.end(), event.thread) == threads.end()) {
+            threads.push_back(event.thread);
+        }
+    }
+
+    std::sort(threads.begin(), threads.end());
+    for (size_t i = 0; i < threads.size(); ++i) {
+        stream << "\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << threads[i]
+               << ", \"args\": {\"name\": \"thread " << threads[i] << "\"}}" << (i + 1 < threads.size() ? "," : "");
+    }
+    stream << "\n], \"displayTimeUnit\": \"ms\"}" << std::endl << std::defaultfloat;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Timeline of a run in the Chrome trace event format, which chrome://tracing and Perfetto open:
+// one complete event per stage, tile and I/O operation, on the thread that ran it. Thread-safe.
+class TraceRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TraceRecorder() : start_(Clock::now()) {}
+
+    // `detail` shows up as the event's only argument, left out if empty.
+    void Record(std::string name, const char* category, Clock::time_point start, Clock::time_point end,
+                std::string detail);
+
+    // Writes every event recorded so far as a JSON trace, with the threads named by first use.
+    void Write(std::ostream& stream) const;
+
+private:
+    struct Event {
+        std::string name;
+        const char* category;
+        double start_microseconds;
+        double duration_microseconds;
+        uint32_t thread;
+        std::string detail;
+    };
+
+    Clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+};
+
+// Records an event spanning its own lifetime on the calling thread; does nothing without a
+// recorder.
+class TraceSpan {
+public:
+    TraceSpan(TraceRecorder* recorder, std::string_view name, const char* category, std::string detail = {})
+        : recorder_(recorder) {
+        if (recorder_) {
+            name_ = name;
+            category_ = category;
+            detail_ = std::move(detail);
+            start_ = TraceRecorder::Clock::now();
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        End();
+    }
+
+    // Ends the event early; the span records nothing more.
+    void End() {
+        if (recorder_) {
+            recorder_->Record(std::move(name_), category_, start_, TraceRecorder::Clock::now(), std::move(detail_));
+            recorder_ = nullptr;
+        }
+    }
+
+private:
+    TraceRecorder* recorder_;
+    std::string name_;
+    const char* category_ = nullptr;
+    std::string detail_;
+    TraceRecorder::Clock::time_point start_;
+};
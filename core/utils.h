@@ -1,17 +1,65 @@
 #pragma once
 
+#include <string>
 #include <string_view>
 #include <charconv>
+#include <cstdint>
+#include <utility>
 
 #include "app_error.h"
 
 template <typename T>
 T SVToType(std::string_view str) {
-    T converted;
+    T converted{};
     auto result = std::from_chars(str.data(), str.data() + str.size(), converted);
-    if (result.ec == std::errc::invalid_argument) {
+    if (result.ec != std::errc()) {
         throw AppError(AppError::FilterArgumentCastError);
     }
 
     return converted;
 }
+
+// Byte count with an optional K, M or G suffix for powers of 1024, e.g. "512M".
+inline size_t SVToByteSize(std::string_view str) {
+    size_t unit = 1;
+    if (!str.empty()) {
+        switch (str.back()) {
+            case 'K':
+                unit = size_t(1) << 10;
+                break;
+            case 'M':
+                unit = size_t(1) << 20;
+                break;
+            case 'G':
+                unit = size_t(1) << 30;
+                break;
+        }
+    }
+    if (unit != 1) {
+        str.remove_suffix(1);
+    }
+
+    const size_t value = SVToType<size_t>(str);
+    if (value > SIZE_MAX / unit) {
+        throw AppError(AppError::FilterArgumentCastError);
+    }
+    return value * unit;
+}
+
+// Image size written as <width>x<height>, e.g. "1920x1080".
+inline std::pair<uint32_t, uint32_t> SVToImageSize(std::string_view str) {
+    size_t separator = str.find('x');
+    if (separator == std::string_view::npos) {
+        throw AppError(AppError::InvalidOptionValue);
+    }
+
+    return {SVToType<uint32_t>(str.substr(0, separator)), SVToType<uint32_t>(str.substr(separator + 1))};
+}
+
+// Shortest text that SVToType<T> parses back to the same value.
+template <typename T>
+std::string TypeToString(T value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, result.ptr);
+}
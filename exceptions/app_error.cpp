@@ -5,38 +5,91 @@
 std::map<AppError::ErrorCode, const char*> AppError::error_messages {
     {NotEnoughFileEntries,
      "Usage: bmp_processor <input_file> <output_file> [<-filter_name> [filter_params]]"
+     "\n       bmp_processor --batch <input_dir> <output_dir> [<-filter_name> [filter_params]]"
+     "\n       bmp_processor --batch=<list_file> [<-filter_name> [filter_params]]"
+     "\n       bmp_processor --serve=<socket_path>"
+     "\n       bmp_processor --generate=<pattern> <output_file>"
+     "\n       bmp_processor --explain [<-filter_name> [filter_params]]"
      "\nAvailable filters:"
      "\n  -crop <width> <height>          Crops image."
      "\n  -gs                             Applies grayscale filter."
      "\n  -neg                            Applies negative filter."
+     "\n  -gamma <gamma>                  Applies gamma correction."
      "\n  -sharp                          Sharpens image."
      "\n  -edge <threshold>               Produces grayscale image with white edges."
      "\n  -blur <sigma>                   Applies gaussian blur to image."
-     "\n  -pixelate <res_multiplier>      Reduces image resolution."},
+     "\n  -pixelate <res_multiplier>      Reduces image resolution."
+     "\nOptions:"
+     "\n  --bpp=<24|1>                    Output bit depth, 1 needs -edge as the last filter."
+     "\n  --threads=<count>               Worker threads, all hardware threads by default."
+     "\n  --utilization                   Reports how busy every thread was."
+     "\n  --optimize                      Rewrites the filter list into a cheaper equivalent."
+     "\n  --tiled                         Runs chains of filters tile by tile, in cache."
+     "\n  --batch[=<list_file>]           Processes a directory, or the pairs of a list file."
+     "\n  --jobs=<count>                  Images processed at once in batch mode."
+     "\n  --memory-limit=<bytes>[K|M|G]   Memory the images processed at once may take."
+     "\n  --cache=<dir>                   Reuses outputs cached in a directory."
+     "\n  --cache-size=<bytes>[K|M|G]     Cache size limit, 1G by default."
+     "\n  --checkpoints=<dir>             Resumes from intermediate images cached in a directory."
+     "\n  --checkpoint-size=<bytes>[K|M|G] Checkpoint size limit, 4G by default."
+     "\n  --cache-stats                   Reports cache hits and misses."
+     "\n  --stats[=json]                  Reports time and memory traffic of every stage."
+     "\n  --perf-counters                 Adds hardware event counts to --stats."
+     "\n  --trace=<file>                  Writes a timeline of stages, tiles and I/O per thread."
+     "\n  --generate=<pattern>            Writes a synthetic image: noise, gradient, checkerboard or edges."
+     "\n  --size=<width>x<height>         Size of the generated image, 1024x1024 by default."
+     "\n  --seed=<number>                 Seed of the noise pattern, 0 by default."
+     "\n  --serve=<socket_path>           Serves requests over a Unix socket until interrupted."
+     "\n  --explain                       Prints the filter stages instead of running them."},
 
     {FilterNameNotSpecified, "No <-filter_name> before [filter_params]"},
     {FilterArgumentCastError, "Invalid filter argument was provided"},
+    {UnknownFilter, "Unknown filter was provided."},
+    {UnknownOption, "Unknown option was provided."},
+    {InvalidOptionValue, "Invalid option value was provided."},
+    {MaskOutputRequiresEdge, "Option --bpp=1 requires -edge as the last filter."},
 
     {FileSignatureError, "Invalid file signature."},
+    {FileHeaderError, "File ends inside its header."},
+    {UnsupportedBitmapFormat, "Only uncompressed 24-bit BMP files are supported."},
+    {PixelArrayTruncated, "File is shorter than the image size in its header."},
     {InputFileIsNotOpen, "Input file cannot be opened."},
     {OutputFileIsNotOpen, "Output file cannot be opened."},
+    {BatchListIsNotOpen, "Batch list cannot be opened."},
+    {BatchListFormatError, "Batch list should consist of <input_file> <output_file> pairs."},
+    {BatchDirectoryError, "Batch input directory cannot be read or output directory cannot be created."},
+    {ServerSocketError, "Server socket cannot be created."},
+    {ServerSocketPathTaken, "Socket path is taken by a file that is not a socket."},
+    {ServeOptionConflict, "Options --cache, --checkpoints, --stats and --trace can't be used with --serve."},
+    {InlineInputError, "Inline input should be a complete BMP file."},
+    {CacheDirectoryError, "Cache directory cannot be created."},
+    {TraceFileIsNotOpen, "Trace file cannot be opened."},
+    {GeneratedImageFilters, "Filters cannot be applied to a generated image."},
+    {ImageSizeMismatch, "Images of different sizes cannot be compared."},
+    {BaselineFormatError, "Baseline should be a file written by --json."},
 
     {CropFilterParamsError, "Params <width> <height> should be supplied for -crop filter."},
     {GrayscaleFilterParamsError, "No params should be supplied for -gs filter."},
     {NegativeFilterParamsError, "No params should be supplied for -neg filter."},
+    {GammaFilterParamsError, "Param <gamma> should be supplied for -gamma filter."},
+    {GammaFilterNonPositive, "Param <gamma> should be positive."},
     {SharpeningFilterParamsError, "No params should be supplied for -sharp filter."},
     {EdgeDetectionFilterParamsError, "Param <threshold> should be supplied for -edge filter."},
     {GaussianBlurFilterParamsError, "Param <sigma> should be supplied for -blur filter."},
     {PixelateFilterParamsError, "Param <res_multiplier> should be supplied for -pixelate filter."},
-    {PixelateFilterMultiplierLimit, "Param <res_multiplier> can't be bigger than 1."}
+    {PixelateFilterMultiplierLimit, "Param <res_multiplier> should be above 0 and at most 1."}
 };
 
 void AppError::PrintMessage() const {
     switch (error_code_) {
         case NotEnoughFileEntries:
-            std::cout << error_messages[error_code_] << std::endl;
+            std::cout << GetMessage() << std::endl;
             break;
         default:
-            std::cerr << error_messages[error_code_] << std::endl;
+            std::cerr << GetMessage() << std::endl;
     }
 }
+
+const char* AppError::GetMessage() const {
+    return error_messages.at(error_code_);
+}
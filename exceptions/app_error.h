@@ -7,11 +7,18 @@ class AppError : std::exception {
 public:
     enum ErrorCode {
         NotEnoughFileEntries,
-        FilterNameNotSpecified,FilterArgumentCastError,
-        FileSignatureError, InputFileIsNotOpen, OutputFileIsNotOpen,
+        FilterNameNotSpecified,FilterArgumentCastError, UnknownFilter,
+        UnknownOption, InvalidOptionValue, MaskOutputRequiresEdge,
+        FileSignatureError, FileHeaderError, UnsupportedBitmapFormat, PixelArrayTruncated,
+        InputFileIsNotOpen, OutputFileIsNotOpen,
+        BatchListIsNotOpen, BatchListFormatError, BatchDirectoryError,
+        ServerSocketError, ServerSocketPathTaken, ServeOptionConflict, InlineInputError,
+        CacheDirectoryError, TraceFileIsNotOpen,
+        GeneratedImageFilters, ImageSizeMismatch, BaselineFormatError,
 
         CropFilterParamsError, GrayscaleFilterParamsError,
-        NegativeFilterParamsError, SharpeningFilterParamsError,
+        NegativeFilterParamsError, GammaFilterParamsError, GammaFilterNonPositive,
+        SharpeningFilterParamsError,
         EdgeDetectionFilterParamsError, GaussianBlurFilterParamsError,
         PixelateFilterParamsError, PixelateFilterMultiplierLimit
     };
@@ -20,6 +27,8 @@ public:
 
     void PrintMessage() const;
 
+    const char* GetMessage() const;
+
 private:
     ErrorCode error_code_;
 
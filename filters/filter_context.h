@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+#include "stats.h"
+#include "task_scheduler.h"
+#include "trace.h"
+
+// State shared by the filters of one pipeline run.
+//
+// Pixel storage is double-buffered: the image's own pixels are the front buffer, the context
+// holds an equally sized back buffer. A neighborhood filter reads the front, renders into the
+// back and flips them, so a whole pipeline touches exactly two images and never copies one.
+class FilterContext {
+public:
+    FilterContext() = default;
+
+    // Filters split their rows between the threads of `scheduler`, which must outlive the context.
+    explicit FilterContext(TaskScheduler* scheduler) : scheduler_(scheduler) {}
+
+    // Calls func(tile_begin, tile_end) for row tiles of [begin, end), in parallel if the context
+    // has a scheduler. Tiles must only write rows they own.
+    template <typename Func>
+    void ParallelFor(uint32_t begin, uint32_t end, Func&& func) {
+        if (!account_usage_ && !trace_) {
+            RunParallel(begin, end, func);
+            return;
+        }
+
+        // The tiles are measured wherever they run; what the calling thread uses in here,
+        // possibly on tiles of other contexts, is taken out of its own usage.
+        const ThreadUsage caller_start = account_usage_ ? ThreadUsage::Read(hardware_counters_) : ThreadUsage();
+        std::mutex tiles_mutex;
+        ThreadUsage tiles_usage;
+        RunParallel(begin, end, [&](uint32_t tile_begin, uint32_t tile_end) {
+            TraceSpan span(trace_, trace_stage_, "tile",
+                           trace_ ? std::to_string(tile_begin) + "-" + std::to_string(tile_end) : std::string());
+            if (!account_usage_) {
+                func(tile_begin, tile_end);
+                return;
+            }
+
+            const ThreadUsage tile_start = ThreadUsage::Read(hardware_counters_);
+            func(tile_begin, tile_end);
+            ThreadUsage tile_usage = ThreadUsage::Read(hardware_counters_);
+            tile_usage -= tile_start;
+            std::lock_guard<std::mutex> lock(tiles_mutex);
+            tiles_usage += tile_usage;
+        });
+        if (account_usage_) {
+            ThreadUsage caller_usage = ThreadUsage::Read(hardware_counters_);
+            caller_usage -= caller_start;
+            usage_adjustment_ += tiles_usage;
+            usage_adjustment_ -= caller_usage;
+        }
+    }
+
+    // Makes ParallelFor record every tile into `trace`, named after the current stage.
+    void SetTrace(TraceRecorder* trace) {
+        trace_ = trace;
+    }
+    void SetTraceStage(std::string stage) {
+        trace_stage_ = std::move(stage);
+    }
+
+    // Makes ParallelFor account for the CPU time of its tiles, and their hardware events with
+    // hardware_counters, as seen by GetUsage.
+    void EnableAccounting(bool hardware_counters) {
+        account_usage_ = true;
+        hardware_counters_ = hardware_counters;
+    }
+
+    // Usage of the calling thread, plus that of the tiles other threads ran for this context.
+    // The difference between two calls on the same thread is the usage of the work in between.
+    ThreadUsage GetUsage() const {
+        ThreadUsage usage = ThreadUsage::Read(hardware_counters_);
+        usage += usage_adjustment_;
+        return usage;
+    }
+
+    // Sizes the back buffer after `image`. Called once per image by the pipeline, so filters
+    // never allocate; running a filter on its own simply allocates on first use.
+    void PrepareBuffers(const Bitmap& image) {
+        back_buffer_.resize(image.GetPixelCount());
+    }
+
+    // Back buffer with the same size and row layout as `image`, contents unspecified.
+    std::vector<Color>& GetBackBuffer(const Bitmap& image) {
+        PrepareBuffers(image);
+        return back_buffer_;
+    }
+
+    // Makes the back buffer the image's pixels; the previous pixels become the back buffer.
+    void Flip(Bitmap& image) {
+        image.SwapPixels(back_buffer_);
+    }
+
+private:
+    template <typename Func>
+    void RunParallel(uint32_t begin, uint32_t end, Func&& func) {
+        if (scheduler_) {
+            scheduler_->ParallelFor(begin, end, func);
+        } else {
+            func(begin, end);
+        }
+    }
+
+    TaskScheduler* scheduler_ = nullptr;
+    bool account_usage_ = false;
+    bool hardware_counters_ = false;
+    TraceRecorder* trace_ = nullptr;
+    std::string trace_stage_;
+    // Wraps around while the calling thread's usage is taken out; only differences are meaningful.
+    ThreadUsage usage_adjustment_;
+    std::vector<Color> back_buffer_;
+};
@@ -1,32 +1,332 @@
 #include "filter_pipeline.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+
+#include "app_error.h"
+#include "hash.h"
+#include "plan_optimizer.h"
+
 using namespace std::string_view_literals;
 
 FiltersPipeline::FilterTable FiltersPipeline::filter_table {
     {"crop"sv, CropFilter::Create},
     {"gs"sv, GrayscaleFilter::Create},
     {"neg"sv, NegativeFilter::Create},
+    {"gamma"sv, GammaFilter::Create},
     {"sharp"sv, SharpeningFilter::Create},
     {"edge"sv, EdgeDetectionFilter::Create},
     {"blur"sv, GaussianBlurFilter::Create},
     {"pixelate"sv, PixelateFilter::Create}
 };
 
-FiltersPipeline::FiltersPipeline(std::vector<FilterInfo>& filter_infos) {
-    for (const auto& filter_info : filter_infos) {
-        auto& filter_create = filter_table[filter_info.GetFilterName()];
-        filters_.push_back(filter_create(filter_info));
+size_t ResolveThreadCount(size_t threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
     }
+    return std::max<size_t>(1, threads);
 }
 
-Bitmap& FiltersPipeline::Apply(Bitmap& image) {
+FiltersPipeline::FiltersPipeline(std::vector<FilterInfo>& filter_infos, const PipelineOptions& options)
+    : own_scheduler_(options.scheduler ? nullptr : new TaskScheduler(ResolveThreadCount(options.threads))),
+      scheduler_(options.scheduler ? *options.scheduler : *own_scheduler_),
+      context_(&scheduler_),
+      checkpoints_(options.checkpoints),
+      stats_(options.stats),
+      trace_(options.trace) {
+    for (const auto& filter_info : filter_infos) {
+        auto filter_create = filter_table.find(filter_info.GetFilterName());
+        if (filter_create == filter_table.end()) {
+            throw AppError(AppError::UnknownFilter);
+        }
+        filters_.push_back(filter_create->second(filter_info));
+    }
+
+    if (options.optimize) {
+        PlanOptimizer::Optimize(filters_);
+    }
     for (const auto& filter : filters_) {
-        filter->Apply(image);
+        if (!canonical_plan_.empty()) {
+            canonical_plan_ += ' ';
+        }
+        canonical_plan_ += filter->Describe();
+    }
+    FusePointFilters();
+    if (options.tiled) {
+        TileFilters();
     }
 
+    std::string stage_plan;
+    for (const auto& filter : filters_) {
+        stage_plan += ' ';
+        stage_plan += filter->Describe();
+        stage_plans_.push_back(stage_plan);
+    }
+}
+
+// Hands every maximal run of consecutive Part filters that pass accept(part) to fuse(run), which
+// returns the filter replacing the run.
+template <typename Part, typename Fuse, typename Accept = bool (*)(const Part*)>
+static std::vector<BaseFilter*> FuseRuns(const std::vector<BaseFilter*>& filters, Fuse fuse,
+                                         Accept accept = [](const Part*) { return true; }) {
+    std::vector<BaseFilter*> fused;
+    std::vector<Part*> run;
+
+    auto flush_run = [&]() {
+        if (!run.empty()) {
+            fused.push_back(fuse(std::move(run)));
+        }
+        run.clear();
+    };
+
+    for (auto& filter : filters) {
+        auto* part = dynamic_cast<Part*>(filter);
+        if (part && accept(part)) {
+            run.push_back(part);
+        } else {
+            flush_run();
+            fused.push_back(filter);
+        }
+    }
+    flush_run();
+
+    return fused;
+}
+
+void FiltersPipeline::FusePointFilters() {
+    filters_ = FuseRuns<ChannelFilter>(filters_, [](std::vector<ChannelFilter*> run) -> BaseFilter* {
+        if (run.size() == 1 && run.front()->IsCheap()) {
+            return run.front();
+        }
+        return new ChannelLutFilter(std::move(run));
+    });
+
+    filters_ = FuseRuns<PointFilter>(filters_, [](std::vector<PointFilter*> run) -> BaseFilter* {
+        if (run.size() == 1) {
+            return run.front();
+        }
+        return new FusedPointFilter(std::move(run));
+    });
+}
+
+void FiltersPipeline::TileFilters() {
+    // A trailing -edge stays on its own, so that ApplyAsMask can still finish with Detect.
+    BaseFilter* trailing_edge = nullptr;
+    if (!filters_.empty() && dynamic_cast<EdgeDetectionFilter*>(filters_.back())) {
+        trailing_edge = filters_.back();
+        filters_.pop_back();
+    }
+
+    auto is_tileable = [](const BaseFilter* filter) { return !filter->GetTileStages().empty(); };
+    filters_ = FuseRuns<BaseFilter>(filters_, [](std::vector<BaseFilter*> run) -> BaseFilter* {
+        if (run.size() == 1) {
+            return run.front();
+        }
+        return new TiledFilter(std::move(run));
+    }, is_tileable);
+
+    if (trailing_edge) {
+        filters_.push_back(trailing_edge);
+    }
+}
+
+Bitmap& FiltersPipeline::Apply(Bitmap& image) {
+    return Apply(image, context_);
+}
+
+BitMask FiltersPipeline::ApplyAsMask(Bitmap& image) {
+    return ApplyAsMask(image, context_);
+}
+
+Bitmap& FiltersPipeline::Apply(Bitmap& image, FilterContext& context) const {
+    ApplyStages(image, context, filters_.size());
     return image;
 }
 
+BitMask FiltersPipeline::ApplyAsMask(Bitmap& image, FilterContext& context) const {
+    const EdgeDetectionFilter* edge_filter = nullptr;
+    if (!filters_.empty()) {
+        edge_filter = dynamic_cast<const EdgeDetectionFilter*>(filters_.back());
+    }
+    if (!edge_filter) {
+        throw AppError(AppError::MaskOutputRequiresEdge);
+    }
+
+    ApplyStages(image, context, filters_.size() - 1);
+    if (!stats_ && !trace_) {
+        return edge_filter->Detect(image, context);
+    }
+
+    const std::string name = edge_filter->Describe();
+    TraceSpan span(trace_, name, "stage");
+    context.SetTraceStage(name);
+
+    StageTimer timer;
+    const ThreadUsage usage_start = context.GetUsage();
+    BitMask mask = edge_filter->Detect(image, context);
+    if (stats_) {
+        const uint64_t pixels = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight();
+        StageStats::Sample sample = timer.Stop(pixels, pixels * sizeof(Color), (pixels + 7) / 8);
+        ThreadUsage usage = context.GetUsage();
+        usage -= usage_start;
+        sample.SetUsage(usage);
+        stats_->Record(name, sample);
+    }
+    return mask;
+}
+
+void FiltersPipeline::RunStage(const BaseFilter& filter, Bitmap& image, FilterContext& context) const {
+    if (!stats_ && !trace_) {
+        filter.Apply(image, context);
+        return;
+    }
+
+    const std::string name = filter.Describe();
+    TraceSpan span(trace_, name, "stage");
+    context.SetTraceStage(name);
+    if (!stats_) {
+        filter.Apply(image, context);
+        return;
+    }
+
+    const uint64_t input_pixels = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight();
+    StageTimer timer;
+    const ThreadUsage usage_start = context.GetUsage();
+    filter.Apply(image, context);
+    const uint64_t output_pixels = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight();
+
+    // A stage that never sweeps the image, like a crop, processes no pixels.
+    const uint64_t sweeps = filter.GetSweepCount();
+    StageStats::Sample sample = timer.Stop(sweeps ? input_pixels : 0, sweeps * input_pixels * sizeof(Color),
+                                           sweeps * output_pixels * sizeof(Color));
+    ThreadUsage usage = context.GetUsage();
+    usage -= usage_start;
+    sample.SetUsage(usage);
+    stats_->Record(name, sample);
+}
+
+// Hash of the visible pixels of the image, chained row by row, seeded with its size.
+static uint64_t HashPixels(const Bitmap& image) {
+    uint64_t hash = static_cast<uint64_t>(image.GetWidth()) << 32 | image.GetHeight();
+    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
+        std::string_view row(reinterpret_cast<const char*>(image.GetRow(y)), sizeof(Color) * image.GetWidth());
+        hash = Hash64::Compute(row, hash);
+    }
+    return hash;
+}
+
+void FiltersPipeline::ApplyStages(Bitmap& image, FilterContext& context, size_t stage_count) const {
+    size_t first_stage = 0;
+    uint64_t input_hash = 0;
+    const size_t input_pixels = static_cast<size_t>(image.GetWidth()) * image.GetHeight();
+    if (checkpoints_) {
+        input_hash = HashPixels(image);
+        first_stage = ResumeFromCheckpoint(image, input_hash, input_pixels, stage_count);
+    }
+
+    if (NeedsBackBuffer()) {
+        context.PrepareBuffers(image);
+    }
+    if (stats_) {
+        context.EnableAccounting(stats_->HasHardwareCounters());
+    }
+    if (trace_) {
+        context.SetTrace(trace_);
+    }
+
+    for (size_t i = first_stage; i < stage_count; ++i) {
+        RunStage(*filters_[i], image, context);
+
+        if (checkpoints_ && IsCheckpoint(i)) {
+            TraceSpan span(trace_, "checkpoint store", "io");
+            // An image too large for the whole limit would only push everything else out.
+            const uint64_t checkpoint_size = sizeof(Bitmap::BMPHeader) + sizeof(Bitmap::DIBHeader) +
+                                             uint64_t{image.GetWidth()} * image.GetHeight() * sizeof(Color);
+            if (checkpoint_size > checkpoints_->GetSizeLimit()) {
+                continue;
+            }
+            const std::string key = GetCheckpointKey(i, input_hash, input_pixels);
+            const std::string temporary_path = checkpoints_->CreateTemporaryFile(key);
+            if (temporary_path.empty()) {
+                continue;
+            }
+            std::ofstream file(temporary_path, std::ios_base::out | std::ios_base::binary);
+            image.ExportRaw(file);
+            file.close();
+            if (file) {
+                checkpoints_->Insert(key, temporary_path);
+            } else {
+                std::remove(temporary_path.c_str());
+            }
+        }
+    }
+}
+
+size_t FiltersPipeline::ResumeFromCheckpoint(Bitmap& image, uint64_t input_hash, size_t input_pixels,
+                                             size_t stage_count) const {
+    for (size_t i = stage_count; i-- > 0;) {
+        if (!IsCheckpoint(i)) {
+            continue;
+        }
+
+        const std::string path = checkpoints_->Find(GetCheckpointKey(i, input_hash, input_pixels));
+        if (path.empty()) {
+            continue;
+        }
+
+        // Loaded aside, so that a damaged checkpoint leaves the image as it was.
+        TraceSpan span(trace_, "checkpoint load", "io");
+        std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+        Bitmap checkpoint;
+        try {
+            checkpoint.LoadRaw(file);
+        } catch (const AppError&) {
+            continue;
+        } catch (const std::exception&) {
+            continue;
+        }
+        image = std::move(checkpoint);
+        return i + 1;
+    }
+    return 0;
+}
+
+bool FiltersPipeline::IsCheckpoint(size_t stage) const {
+    // Cheap stages are simply run again; the output of the last one is the result cache's business.
+    return stage + 1 < filters_.size() && filters_[stage]->NeedsBackBuffer();
+}
+
+std::string FiltersPipeline::GetCheckpointKey(size_t stage, uint64_t input_hash, size_t input_pixels) const {
+    return ResultCache::FormatKey(Hash64::Compute(stage_plans_[stage], input_hash), input_pixels);
+}
+
+bool FiltersPipeline::NeedsBackBuffer() const {
+    return std::any_of(filters_.begin(), filters_.end(), [](const BaseFilter* filter) {
+        return filter->NeedsBackBuffer();
+    });
+}
+
+size_t FiltersPipeline::EstimateMemory(uint32_t width, uint32_t height, uint32_t bits_per_pixel) const {
+    const size_t image_bytes = sizeof(Color) * width * height;
+
+    size_t bytes = image_bytes;
+    if (NeedsBackBuffer()) {
+        bytes += image_bytes;
+    }
+    if (bits_per_pixel == 1) {
+        bytes += static_cast<size_t>(BitMask::GetRowSize(width)) * height;
+    }
+    return bytes;
+}
+
+void FiltersPipeline::Explain(std::ostream& stream) const {
+    for (size_t i = 0; i < filters_.size(); ++i) {
+        stream << i + 1 << ". " << filters_[i]->Describe() << std::endl;
+    }
+}
+
 FiltersPipeline::~FiltersPipeline() {
     for (auto& filter : filters_) {
         delete filter;
@@ -2,24 +2,126 @@
 
 #include <vector>
 #include <functional>
+#include <string>
 #include <string_view>
 #include <map>
+#include <memory>
+#include <ostream>
 
 #include "bitmap.h"
+#include "bitmask.h"
 #include "filters.h"
+#include "task_scheduler.h"
+#include "result_cache.h"
+#include "stats.h"
+#include "trace.h"
+
+struct PipelineOptions {
+    // Rewrite the filter list with PlanOptimizer before running it.
+    bool optimize = false;
+    // Threads every filter splits its rows between, 0 stands for the hardware concurrency.
+    size_t threads = 0;
+    // Run chains of neighborhood and point filters tile by tile with TiledFilter.
+    bool tiled = false;
+    // Scheduler to run on instead of one of the pipeline's own, so that many pipelines can share
+    // the same threads. Must outlive the pipeline; `threads` is ignored then.
+    TaskScheduler* scheduler = nullptr;
+    // Cache of intermediate images to resume from, must outlive the pipeline.
+    ResultCache* checkpoints = nullptr;
+    // Where to record the time and traffic of every stage, must outlive the pipeline.
+    StageStats* stats = nullptr;
+    // Where to record the timeline of stages and tiles, must outlive the pipeline.
+    TraceRecorder* trace = nullptr;
+};
+
+// Thread count for a --threads value, 0 standing for the hardware concurrency.
+size_t ResolveThreadCount(size_t threads);
 
 class FiltersPipeline {
 public:
     using FilterTable = std::map<std::string_view, std::function<BaseFilter*(const FilterInfo&)>>;
 
-    FiltersPipeline(std::vector<FilterInfo>& filter_infos);
+    FiltersPipeline(std::vector<FilterInfo>& filter_infos, const PipelineOptions& options = {});
 
     Bitmap& Apply(Bitmap& image);
 
+    // Runs the pipeline, finishing with a packed edge mask. The last filter must be -edge.
+    BitMask ApplyAsMask(Bitmap& image);
+
+    // Same as above, with buffers from `context` instead of the pipeline's own. The filters are
+    // immutable, so images with different contexts may run through the pipeline concurrently.
+    Bitmap& Apply(Bitmap& image, FilterContext& context) const;
+    BitMask ApplyAsMask(Bitmap& image, FilterContext& context) const;
+
+    // Context that splits rows between the pipeline's threads, to be passed to the calls above.
+    FilterContext CreateContext() {
+        return FilterContext(&scheduler_);
+    }
+
+    TaskScheduler& GetScheduler() {
+        return scheduler_;
+    }
+    const TaskScheduler& GetScheduler() const {
+        return scheduler_;
+    }
+
+    // Bytes an image of the given size holds while it runs through the pipeline: its pixels, the
+    // back buffer if any stage renders into one, and the mask for bits_per_pixel == 1.
+    size_t EstimateMemory(uint32_t width, uint32_t height, uint32_t bits_per_pixel) const;
+
+    // The filters as they run, before they are fused, e.g. "-gs -blur 2". Plans that give the same
+    // output describe themselves the same way, however their filters were spelled.
+    const std::string& GetCanonicalPlan() const {
+        return canonical_plan_;
+    }
+
+    // Stats and trace the stages are recorded into, or null; callers add their own I/O to them.
+    StageStats* GetStats() const {
+        return stats_;
+    }
+    TraceRecorder* GetTrace() const {
+        return trace_;
+    }
+
+    // Prints the stages that Apply runs, one per line.
+    void Explain(std::ostream& stream) const;
+
     ~FiltersPipeline();
 
 private:
+    // Compiles runs of channel filters into lookup tables, then replaces every run of point
+    // filters with one FusedPointFilter.
+    void FusePointFilters();
+
+    // Replaces every run of filters with tile stages by one TiledFilter.
+    void TileFilters();
+
+    bool NeedsBackBuffer() const;
+
+    // Runs the first stage_count stages. With checkpoints, the image is first replaced by the
+    // checkpoint of the longest cached prefix of those stages, if any, and the output of every
+    // expensive stage is checkpointed as it is run.
+    void ApplyStages(Bitmap& image, FilterContext& context, size_t stage_count) const;
+
+    // Loads the latest checkpoint before stage_count and returns the stage to continue from.
+    size_t ResumeFromCheckpoint(Bitmap& image, uint64_t input_hash, size_t input_pixels, size_t stage_count) const;
+
+    // Applies one stage, recording it into the stats and the trace if there are any.
+    void RunStage(const BaseFilter& filter, Bitmap& image, FilterContext& context) const;
+
+    bool IsCheckpoint(size_t stage) const;
+    std::string GetCheckpointKey(size_t stage, uint64_t input_hash, size_t input_pixels) const;
+
     std::vector<BaseFilter*> filters_;
+    std::string canonical_plan_;
+    std::unique_ptr<TaskScheduler> own_scheduler_;
+    TaskScheduler& scheduler_;
+    FilterContext context_;
+    ResultCache* checkpoints_;
+    StageStats* stats_;
+    TraceRecorder* trace_;
+    // Descriptions of the stages up to each one, which key their checkpoints.
+    std::vector<std::string> stage_plans_;
 
     static FilterTable filter_table;
 };
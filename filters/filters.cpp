@@ -3,8 +3,235 @@
 #include <cmath>
 
 #include "utils.h"
+#include "stencil.h"
 #include "app_error.h"
 
+using SharpeningKernel = StencilKernel<3,
+     0, -1,  0,
+    -1,  5, -1,
+     0, -1,  0>;
+
+using LaplacianKernel = StencilKernel<3,
+     0, -1,  0,
+    -1,  4, -1,
+     0, -1,  0>;
+
+// Renders all rows of the image into the back buffer with render(src, dst, out), one band of rows
+// per task, then flips.
+template <typename Render>
+static void RenderToBackBuffer(Bitmap& image, FilterContext& context, Render&& render) {
+    const PixelView src = ViewPixels(image);
+    const MutablePixelView dst = ViewBuffer(context.GetBackBuffer(image), image);
+
+    context.ParallelFor(0, image.GetHeight(), [&](uint32_t begin, uint32_t end) {
+        render(src, dst, Rect{0, begin, image.GetWidth(), end});
+    });
+
+    context.Flip(image);
+}
+
+void PointFilter::Apply(Bitmap& image, FilterContext& context) const {
+    context.ParallelFor(0, image.GetHeight(), [&](uint32_t begin, uint32_t end) {
+        for (uint32_t y = begin; y < end; ++y) {
+            MapPixels(image.GetRow(y), image.GetWidth());
+        }
+    });
+}
+
+std::vector<TileStage> PointFilter::GetTileStages() const {
+    auto render = [this](const PixelView&, const MutablePixelView& dst, const Rect& out) {
+        for (int64_t y = out.top; y < out.bottom; ++y) {
+            MapPixels(&dst.At(out.left, y), out.GetWidth());
+        }
+    };
+    return {TileStage{0, 0, true, render}};
+}
+
+void FusedPointFilter::MapPixels(Color* pixels, size_t count) const {
+    for (size_t begin = 0; begin < count; begin += kChunkSize) {
+        size_t chunk_size = std::min(kChunkSize, count - begin);
+        for (const auto& filter : filters_) {
+            filter->MapPixels(pixels + begin, chunk_size);
+        }
+    }
+}
+
+std::string FusedPointFilter::Describe() const {
+    std::string description = "fused(";
+    for (size_t i = 0; i < filters_.size(); ++i) {
+        if (i > 0) {
+            description += ' ';
+        }
+        description += filters_[i]->Describe();
+    }
+    return description + ")";
+}
+
+FusedPointFilter::~FusedPointFilter() {
+    for (auto& filter : filters_) {
+        delete filter;
+    }
+}
+
+TiledFilter::TiledFilter(std::vector<BaseFilter*> filters) : filters_(std::move(filters)) {
+    for (const auto& filter : filters_) {
+        for (auto& stage : filter->GetTileStages()) {
+            halo_x_ += stage.halo_x;
+            halo_y_ += stage.halo_y;
+            stages_.push_back(std::move(stage));
+        }
+    }
+}
+
+void TiledFilter::Apply(Bitmap& image, FilterContext& context) const {
+    // Tiles much smaller than their halo would mostly recompute it.
+    const int64_t tile_width = std::max(kTileWidth, 4 * halo_x_);
+    const int64_t tile_height = std::max(kTileHeight, 4 * halo_y_);
+    const int64_t width = image.GetWidth();
+    const int64_t height = image.GetHeight();
+    const int64_t tiles_x = (width + tile_width - 1) / tile_width;
+    const int64_t tiles_y = (height + tile_height - 1) / tile_height;
+
+    const PixelView src = ViewPixels(image);
+    const MutablePixelView dst = ViewBuffer(context.GetBackBuffer(image), image);
+
+    context.ParallelFor(0, tiles_x * tiles_y, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t tile = begin; tile < end; ++tile) {
+            const int64_t left = tile % tiles_x * tile_width;
+            const int64_t top = tile / tiles_x * tile_height;
+            RenderTile(src, dst, Rect{left, top, std::min(width, left + tile_width), std::min(height, top + tile_height)});
+        }
+    });
+
+    context.Flip(image);
+}
+
+void TiledFilter::RenderTile(const PixelView& image, const MutablePixelView& result, const Rect& tile) const {
+    const Rect bounds{0, 0, image.GetImageWidth(), image.GetImageHeight()};
+    const Rect window = tile.Expand(halo_x_, halo_y_, bounds);
+    const size_t window_size = window.GetWidth() * window.GetHeight();
+
+    // Intermediate results of the tile, window-sized and reused by every tile the thread renders.
+    thread_local std::vector<Color> buffers[2];
+    std::vector<MutablePixelView> scratch;
+    for (auto& buffer : buffers) {
+        if (buffer.size() < window_size) {
+            buffer.resize(window_size);
+        }
+        scratch.emplace_back(buffer.data(), window.GetWidth(), window, bounds.right, bounds.bottom);
+    }
+
+    // Stage i renders the tile grown by the halo of the stages after it; neighbors outside the
+    // image are clamped exactly as on a whole image, so tiles match the untiled result bit for bit.
+    PixelView src = image;
+    int current = -1;
+    int64_t halo_x = halo_x_;
+    int64_t halo_y = halo_y_;
+    for (size_t i = 0; i < stages_.size(); ++i) {
+        const TileStage& stage = stages_[i];
+        halo_x -= stage.halo_x;
+        halo_y -= stage.halo_y;
+        const Rect out = tile.Expand(halo_x, halo_y, bounds);
+        const bool last = i + 1 == stages_.size();
+
+        int next = current == 0 ? 1 : 0;
+        if (stage.in_place && current >= 0) {
+            next = current;
+        }
+        const MutablePixelView& dst = last ? result : scratch[next];
+
+        if (stage.in_place) {
+            if (last || next != current) {
+                CopyPixels(src, dst, out);
+            }
+            stage.render(dst, dst, out);
+        } else {
+            stage.render(src, dst, out);
+        }
+
+        src = dst;
+        current = next;
+    }
+}
+
+std::string TiledFilter::Describe() const {
+    std::string description = "tiled(";
+    for (size_t i = 0; i < filters_.size(); ++i) {
+        if (i > 0) {
+            description += ' ';
+        }
+        description += filters_[i]->Describe();
+    }
+    return description + ")";
+}
+
+TiledFilter::~TiledFilter() {
+    for (auto& filter : filters_) {
+        delete filter;
+    }
+}
+
+void ChannelFilter::MapPixels(Color* pixels, size_t count) const {
+    for (size_t i = 0; i < count; ++i) {
+        Color& pixel = pixels[i];
+        pixel.Set(MapChannel(pixel.R), MapChannel(pixel.G), MapChannel(pixel.B));
+    }
+}
+
+// Channel values of a freshly loaded image, exactly as Bitmap::Load computes them.
+static const std::array<double, 256> kChannelLevels = [] {
+    std::array<double, 256> levels;
+    for (int level = 0; level < 256; ++level) {
+        levels[level] = level / 255.0;
+    }
+    return levels;
+}();
+
+ChannelLutFilter::ChannelLutFilter(std::vector<ChannelFilter*> filters) : filters_(std::move(filters)) {
+    for (size_t level = 0; level < table_.size(); ++level) {
+        table_[level] = MapChannel(kChannelLevels[level]);
+    }
+}
+
+double ChannelLutFilter::MapChannel(double value) const {
+    for (const auto& filter : filters_) {
+        value = filter->MapChannel(value);
+    }
+    return value;
+}
+
+void ChannelLutFilter::MapPixels(Color* pixels, size_t count) const {
+    auto map = [this](double value) {
+        long level = std::lrint(value * 255);
+        if (level >= 0 && level <= 255 && kChannelLevels[level] == value) {
+            return table_[level];
+        }
+        return MapChannel(value);
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        Color& pixel = pixels[i];
+        pixel.Set(map(pixel.R), map(pixel.G), map(pixel.B));
+    }
+}
+
+std::string ChannelLutFilter::Describe() const {
+    std::string description = "lut(";
+    for (size_t i = 0; i < filters_.size(); ++i) {
+        if (i > 0) {
+            description += ' ';
+        }
+        description += filters_[i]->Describe();
+    }
+    return description + ")";
+}
+
+ChannelLutFilter::~ChannelLutFilter() {
+    for (auto& filter : filters_) {
+        delete filter;
+    }
+}
+
 BaseFilter* CropFilter::Create(const FilterInfo& info) {
     const auto& params = info.GetParams();
 
@@ -18,10 +245,14 @@ BaseFilter* CropFilter::Create(const FilterInfo& info) {
     return new CropFilter(new_width, new_height);
 }
 
-void CropFilter::Apply(Bitmap& image) const {
+void CropFilter::Apply(Bitmap& image, FilterContext& context) const {
     image.Crop(new_width_, new_height_);
 }
 
+std::string CropFilter::Describe() const {
+    return "-crop " + TypeToString(new_width_) + " " + TypeToString(new_height_);
+}
+
 BaseFilter* GrayscaleFilter::Create(const FilterInfo& info) {
     const auto& params = info.GetParams();
 
@@ -32,13 +263,14 @@ BaseFilter* GrayscaleFilter::Create(const FilterInfo& info) {
     return new GrayscaleFilter();
 }
 
-void GrayscaleFilter::Apply(Bitmap& image) const {
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            Color& pixel = image.GetPixel(x, y);
-            double new_val = 0.299 * pixel.R + 0.587 * pixel.G + 0.114 * pixel.B;
-            pixel.Set(new_val, new_val, new_val);
-        }
+std::string GrayscaleFilter::Describe() const {
+    return "-gs";
+}
+
+void GrayscaleFilter::MapPixels(Color* pixels, size_t count) const {
+    for (size_t i = 0; i < count; ++i) {
+        double new_val = Luma(pixels[i]);
+        pixels[i].Set(new_val, new_val, new_val);
     }
 }
 
@@ -52,13 +284,28 @@ BaseFilter* NegativeFilter::Create(const FilterInfo& info) {
     return new NegativeFilter();
 }
 
-void NegativeFilter::Apply(Bitmap& image) const {
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            Color& pixel = image.GetPixel(x, y);
-            pixel.Set(1 - pixel.R, 1 - pixel.G, 1 - pixel.B);
-        }
+std::string NegativeFilter::Describe() const {
+    return "-neg";
+}
+
+BaseFilter* GammaFilter::Create(const FilterInfo& info) {
+    const auto& params = info.GetParams();
+
+    if (params.size() != 1) {
+        throw AppError(AppError::GammaFilterParamsError);
     }
+
+    double gamma = SVToType<double>(params[0]);
+
+    if (!(gamma > 0)) {
+        throw AppError(AppError::GammaFilterNonPositive);
+    }
+
+    return new GammaFilter(gamma);
+}
+
+std::string GammaFilter::Describe() const {
+    return "-gamma " + TypeToString(gamma_);
 }
 
 BaseFilter* SharpeningFilter::Create(const FilterInfo& info) {
@@ -71,37 +318,32 @@ BaseFilter* SharpeningFilter::Create(const FilterInfo& info) {
     return new SharpeningFilter();
 }
 
-void SharpeningFilter::Apply(Bitmap& image) const {
-    std::vector<std::vector<Color>> new_colors(image.GetHeight(), std::vector<Color>(image.GetHeight()));
-
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            Color& up = image.GetClosestPixel(x, y - 1);
-            Color& down = image.GetClosestPixel(x, y + 1);
-            Color& left = image.GetClosestPixel(x - 1, y);
-            Color& right = image.GetClosestPixel(x + 1, y);
-            Color& center = image.GetPixel(x, y);
-
-            double red = up.R * -1 + left.R * -1 + center.R * 5 + right.R * -1 + down.R * -1;
-            double green = up.G * -1 + left.G * -1 + center.G * 5 + right.G * -1 + down.G * -1;
-            double blue = up.B * -1 + left.B * -1 + center.B * 5 + right.B * -1 + down.B * -1;
+void SharpeningFilter::Apply(Bitmap& image, FilterContext& context) const {
+    RenderToBackBuffer(image, context, [&](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+        Render(src, dst, out);
+    });
+}
 
-            red = std::max(0.0, std::min(1.0, red));
-            green = std::max(0.0, std::min(1.0, green));
-            blue = std::max(0.0, std::min(1.0, blue));
+std::vector<TileStage> SharpeningFilter::GetTileStages() const {
+    const int32_t radius = SharpeningKernel::kRadius;
+    auto render = [this](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+        Render(src, dst, out);
+    };
+    return {TileStage{radius, radius, false, render}};
+}
 
-            Color new_color;
-            new_color.Set(red, green, blue);
+void SharpeningFilter::Render(const PixelView& src, const MutablePixelView& dst, const Rect& out) const {
+    ApplyStencil<SharpeningKernel>(src, out, [&](int64_t x, int64_t y, const Color& sum) {
+        double red = std::max(0.0, std::min(1.0, sum.R));
+        double green = std::max(0.0, std::min(1.0, sum.G));
+        double blue = std::max(0.0, std::min(1.0, sum.B));
 
-            new_colors[y][x] = new_color;
-        }
-    }
+        dst.At(x, y).Set(red, green, blue);
+    });
+}
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            image.GetPixel(x, y) = new_colors[y][x];
-        }
-    }
+std::string SharpeningFilter::Describe() const {
+    return "-sharp";
 }
 
 BaseFilter* EdgeDetectionFilter::Create(const FilterInfo& info) {
@@ -116,36 +358,100 @@ BaseFilter* EdgeDetectionFilter::Create(const FilterInfo& info) {
     return new EdgeDetectionFilter(threshold);
 }
 
-void EdgeDetectionFilter::Apply(Bitmap& image) const {
-    GrayscaleFilter gs_filter;
-    gs_filter.Apply(image);
+template <typename Store>
+void EdgeDetectionFilter::DetectEdges(const PixelView& src, const Rect& out, Store&& store) const {
+    const int64_t width = src.GetImageWidth();
+    const int64_t height = src.GetImageHeight();
+    const int64_t y_begin = out.top;
+    const int64_t y_end = out.bottom;
+
+    // Columns the Laplacian reads for `out`.
+    const int64_t left = std::max<int64_t>(0, out.left - LaplacianKernel::kRadius);
+    const int64_t right = std::max(left, std::min<int64_t>(width, out.right + LaplacianKernel::kRadius));
+    const int64_t span = right - left;
+
+    // Luma of the rows above, at and below the current one. Each row is converted once, right
+    // before the window reaches it, so the store may overwrite rows the window has passed.
+    std::vector<double> luma_rows(3 * span);
+    auto load_luma = [&](double* luma, int64_t y) {
+        const Color* row = &src.At(left, y);
+        for (int64_t x = 0; x < span; ++x) {
+            luma[x] = GrayscaleFilter::Luma(row[x]);
+        }
+    };
 
-    std::vector<std::vector<bool>> new_colors(image.GetHeight(), std::vector<bool>(image.GetHeight()));
+    double* above = luma_rows.data();
+    double* center = above + span;
+    double* below = center + span;
+    if (y_begin > 0) {
+        load_luma(center, y_begin - 1);
+    }
+    if (y_begin < y_end) {
+        load_luma(below, y_begin);
+    }
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            Color& up = image.GetClosestPixel(x, y - 1);
-            Color& down = image.GetClosestPixel(x, y + 1);
-            Color& left = image.GetClosestPixel(x - 1, y);
-            Color& right = image.GetClosestPixel(x + 1, y);
-            Color& center = image.GetPixel(x, y);
+    for (int64_t y = y_begin; y < y_end; ++y) {
+        std::swap(above, center);
+        std::swap(center, below);
+        if (y + 1 < height) {
+            load_luma(below, y + 1);
+        }
 
-            double val = up.R * -1 + left.R * -1 + center.R * 4 + right.R * -1 + down.R * -1;
+        const double* rows[] = {y > 0 ? above : center, center, y + 1 < height ? below : center};
+        ForEachInRowWindow<LaplacianKernel::kRadius>(rows, out.left, out.right, left, width,
+                                                     [&](int64_t x, const auto& pixels) {
+            double val = LaplacianKernel::Sum(pixels, [](double luma) { return luma; });
 
             val = std::max(0.0, std::min(1.0, val));
 
-            new_colors[y][x] = val > threshold_;
-        }
+            store(x, y, val > threshold_);
+        });
     }
+}
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            image.GetPixel(x, y) = new_colors[y][x] ? Color(1, 1, 1) : Color(0, 0, 0);
-        }
-    }
+void EdgeDetectionFilter::Apply(Bitmap& image, FilterContext& context) const {
+    // Bands read the luma of their neighbors' boundary rows, so the result goes to the back buffer
+    // rather than over the source.
+    RenderToBackBuffer(image, context, [&](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+        Render(src, dst, out);
+    });
+}
+
+std::vector<TileStage> EdgeDetectionFilter::GetTileStages() const {
+    const int32_t radius = LaplacianKernel::kRadius;
+    auto render = [this](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+        Render(src, dst, out);
+    };
+    return {TileStage{radius, radius, false, render}};
+}
+
+void EdgeDetectionFilter::Render(const PixelView& src, const MutablePixelView& dst, const Rect& out) const {
+    DetectEdges(src, out, [&](int64_t x, int64_t y, bool edge) {
+        dst.At(x, y) = edge ? Color(1, 1, 1) : Color(0, 0, 0);
+    });
 }
 
-GaussianBlurFilter::GaussianBlurFilter(double sigma) : sigma_(sigma), radius_(std::round(3 * sigma)) {}
+BitMask EdgeDetectionFilter::Detect(Bitmap& image, FilterContext& context) const {
+    BitMask edges(image.GetWidth(), image.GetHeight());
+    const PixelView src = ViewPixels(image);
+
+    context.ParallelFor(0, image.GetHeight(), [&](uint32_t begin, uint32_t end) {
+        DetectEdges(src, Rect{0, begin, image.GetWidth(), end}, [&](int64_t x, int64_t y, bool edge) {
+            if (edge) {
+                edges.Set(x, y);
+            }
+        });
+    });
+
+    return edges;
+}
+
+std::string EdgeDetectionFilter::Describe() const {
+    return "-edge " + TypeToString(threshold_);
+}
+
+GaussianBlurFilter::GaussianBlurFilter(double sigma)
+    : sigma_(sigma), radius_(std::round(3 * sigma)), weights_(CalcWeights()) {}
 
 BaseFilter* GaussianBlurFilter::Create(const FilterInfo& info) {
     const auto& params = info.GetParams();
@@ -156,6 +462,10 @@ BaseFilter* GaussianBlurFilter::Create(const FilterInfo& info) {
 
     double sigma = SVToType<double>(params[0]);
 
+    if (!(sigma > 0)) {
+        throw AppError(AppError::GaussianBlurFilterParamsError);
+    }
+
     return new GaussianBlurFilter(sigma);
 }
 
@@ -163,68 +473,60 @@ double GaussianBlurFilter::GaussFunc(int32_t i) const {
     return 1 / std::sqrt(2 * std::numbers::pi) / sigma_ * std::exp(-i * i / (2 * sigma_ * sigma_));
 }
 
-Color GaussianBlurFilter::CalcNewPixelHorizontal(Bitmap& image, uint32_t x, uint32_t y) const {
-    Color result(0, 0, 0);
-
+std::vector<double> GaussianBlurFilter::CalcWeights() const {
+    std::vector<double> weights(2 * radius_ + 1);
     for (int32_t i = -radius_; i <= radius_; ++i) {
-        Color& pixel = image.GetClosestPixel(x + i, y);
-        double expr = GaussFunc(i);
-        result.R += pixel.R * expr;
-        result.G += pixel.G * expr;
-        result.B += pixel.B * expr;
+        weights[i + radius_] = GaussFunc(i);
     }
-
-    result.R = std::max(0.0, std::min(1.0, result.R));
-    result.G = std::max(0.0, std::min(1.0, result.G));
-    result.B = std::max(0.0, std::min(1.0, result.B));
-
-    return result;
+    return weights;
 }
 
-Color GaussianBlurFilter::CalcNewPixelVertical(Bitmap& image, uint32_t x, uint32_t y) const {
-    Color result(0, 0, 0);
-
-    for (int32_t i = -radius_; i <= radius_; ++i) {
-        Color& pixel = image.GetClosestPixel(x, y + i);
-        double expr = GaussFunc(i);
-        result.R += pixel.R * expr;
-        result.G += pixel.G * expr;
-        result.B += pixel.B * expr;
-    }
-
-    result.R = std::max(0.0, std::min(1.0, result.R));
-    result.G = std::max(0.0, std::min(1.0, result.G));
-    result.B = std::max(0.0, std::min(1.0, result.B));
+void GaussianBlurFilter::Apply(Bitmap& image, FilterContext& context) const {
+    auto blur_pass = [&](int32_t step_x, int32_t step_y) {
+        RenderToBackBuffer(image, context, [&](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+            RenderPass(step_x, step_y, src, dst, out);
+        });
+    };
 
-    return result;
+    blur_pass(1, 0);
+    blur_pass(0, 1);
 }
 
-void GaussianBlurFilter::Apply(Bitmap& image) const {
-    std::vector<std::vector<Color>> new_colors(image.GetHeight(), std::vector<Color>(image.GetHeight()));
+std::vector<TileStage> GaussianBlurFilter::GetTileStages() const {
+    auto horizontal = [this](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+        RenderPass(1, 0, src, dst, out);
+    };
+    auto vertical = [this](const PixelView& src, const MutablePixelView& dst, const Rect& out) {
+        RenderPass(0, 1, src, dst, out);
+    };
+    return {TileStage{radius_, 0, false, horizontal}, TileStage{0, radius_, false, vertical}};
+}
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            new_colors[y][x] = CalcNewPixelHorizontal(image, x, y);
+void GaussianBlurFilter::RenderPass(int32_t step_x, int32_t step_y, const PixelView& src,
+                                    const MutablePixelView& dst, const Rect& out) const {
+    auto blur_pixel = [&](int64_t x, int64_t y, const auto& pixels) {
+        Color result(0, 0, 0);
+
+        for (int32_t i = -radius_; i <= radius_; ++i) {
+            const Color& pixel = pixels(i * step_x, i * step_y);
+            double expr = weights_[i + radius_];
+            result.R += pixel.R * expr;
+            result.G += pixel.G * expr;
+            result.B += pixel.B * expr;
         }
-    }
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            image.GetPixel(x, y) = new_colors[y][x];
-        }
-    }
+        result.R = std::max(0.0, std::min(1.0, result.R));
+        result.G = std::max(0.0, std::min(1.0, result.G));
+        result.B = std::max(0.0, std::min(1.0, result.B));
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            new_colors[y][x] = CalcNewPixelVertical(image, x, y);
-        }
-    }
+        dst.At(x, y) = result;
+    };
 
-    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
-        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
-            image.GetPixel(x, y) = new_colors[y][x];
-        }
-    }
+    ForEachNeighborhood(src, radius_ * step_x, radius_ * step_y, out, blur_pixel);
+}
+
+std::string GaussianBlurFilter::Describe() const {
+    return "-blur " + TypeToString(sigma_);
 }
 
 BaseFilter* PixelateFilter::Create(const FilterInfo& info) {
@@ -236,38 +538,66 @@ BaseFilter* PixelateFilter::Create(const FilterInfo& info) {
 
     double res_multiplier = SVToType<double>(params[0]);
 
-    if (res_multiplier > 1) {
+    // Written so that NaN fails too.
+    if (!(res_multiplier > 0 && res_multiplier <= 1)) {
         throw AppError(AppError::PixelateFilterMultiplierLimit);
     }
 
     return new PixelateFilter(res_multiplier);
 }
 
-void PixelateFilter::Apply(Bitmap& image) const {
-    uint32_t new_width = std::round(image.GetWidth() * res_multiplier_);
-    uint32_t new_height = std::round(image.GetHeight() * res_multiplier_);
-
-    int32_t radius = std::round(1 / res_multiplier_);
+void PixelateFilter::Apply(Bitmap& image, FilterContext& context) const {
+    const uint64_t width = image.GetWidth();
+    const uint64_t height = image.GetHeight();
+    const uint32_t new_width = std::max<uint32_t>(1, std::round(width * res_multiplier_));
+    const uint32_t new_height = std::max<uint32_t>(1, std::round(height * res_multiplier_));
+
+    // Block i covers source columns [block_x[i], block_x[i + 1]), so blocks tile the image
+    // exactly even when 1 / res_multiplier is not an integer.
+    std::vector<uint32_t> block_x(new_width + 1);
+    for (uint32_t new_x = 0; new_x <= new_width; ++new_x) {
+        block_x[new_x] = new_x * width / new_width;
+    }
 
-    for (uint32_t new_y = 0; new_y < new_height; ++new_y) {
-        for (uint32_t new_x = 0; new_x < new_width; ++new_x) {
-            Color new_color(0, 0, 0);
-            for (uint32_t y = new_y * radius; y < (new_y + 1) * radius; ++y) {
-                for (uint32_t x = new_x * radius; x < (new_x + 1) * radius; ++x) {
-                    Color& color = image.GetClosestPixel(x, y);
-                    new_color.R += color.R;
-                    new_color.G += color.G;
-                    new_color.B += color.B;
+    std::vector<Color>& new_colors = context.GetBackBuffer(image);
+    const int64_t stride = image.GetStride();
+
+    // Streams the source rows of every block row once, adding each pixel to its block's sum.
+    auto pixelate_block_rows = [&](uint32_t begin, uint32_t end) {
+        std::vector<Color> sums(new_width);
+
+        for (uint32_t new_y = begin; new_y < end; ++new_y) {
+            const uint32_t y_begin = new_y * height / new_height;
+            const uint32_t y_end = (new_y + 1) * height / new_height;
+
+            std::fill(sums.begin(), sums.end(), Color(0, 0, 0));
+            for (uint32_t y = y_begin; y < y_end; ++y) {
+                const Color* row = image.GetRow(y);
+                for (uint32_t new_x = 0; new_x < new_width; ++new_x) {
+                    Color& sum = sums[new_x];
+                    for (uint32_t x = block_x[new_x]; x < block_x[new_x + 1]; ++x) {
+                        sum.R += row[x].R;
+                        sum.G += row[x].G;
+                        sum.B += row[x].B;
+                    }
                 }
             }
 
-            new_color.R /= radius * radius;
-            new_color.G /= radius * radius;
-            new_color.B /= radius * radius;
-
-            image.GetPixel(new_x, new_y) = new_color;
+            Color* new_row = new_colors.data() + stride * new_y;
+            for (uint32_t new_x = 0; new_x < new_width; ++new_x) {
+                double block_size = (block_x[new_x + 1] - block_x[new_x]) * (y_end - y_begin);
+                new_row[new_x].Set(sums[new_x].R / block_size, sums[new_x].G / block_size,
+                                   sums[new_x].B / block_size);
+            }
         }
-    }
+    };
+
+    context.ParallelFor(0, new_height, pixelate_block_rows);
 
+    context.Flip(image);
     image.Crop(new_width, new_height);
 }
+
+std::string PixelateFilter::Describe() const {
+    return "-pixelate " + TypeToString(res_multiplier_);
+}
@@ -1,20 +1,183 @@
 #pragma once
 
+#include <array>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "parser.h"
 #include "bitmap.h"
+#include "bitmask.h"
+#include "filter_context.h"
+#include "pixel_view.h"
+
+// One pass of a filter over part of an image. render(src, dst, out) writes every pixel of `out`
+// to dst, reading src at most halo_x / halo_y pixels around `out`. In-place stages are handed the
+// same view as src and dst.
+struct TileStage {
+    int32_t halo_x = 0;
+    int32_t halo_y = 0;
+    bool in_place = false;
+    std::function<void(const PixelView& src, const MutablePixelView& dst, const Rect& out)> render;
+};
 
 class BaseFilter {
 public:
-    virtual void Apply(Bitmap& image) const = 0;
+    // Runs the filter on its own, with a context that lives for this call only.
+    void Apply(Bitmap& image) const {
+        FilterContext context;
+        Apply(image, context);
+    }
+
+    virtual void Apply(Bitmap& image, FilterContext& context) const = 0;
+
+    // Passes that give the same result as Apply when run in order over any part of the image.
+    // Filters that change the image size or need the whole image have none and are never tiled.
+    virtual std::vector<TileStage> GetTileStages() const {
+        return {};
+    }
+
+    // Whether Apply renders into the context's back buffer.
+    virtual bool NeedsBackBuffer() const {
+        return true;
+    }
+
+    // Times Apply reads and writes the whole image, for estimating its memory traffic.
+    virtual size_t GetSweepCount() const {
+        return 1;
+    }
+
+    // Filter as it would be written on the command line, e.g. "-blur 2.5".
+    virtual std::string Describe() const = 0;
 
     virtual ~BaseFilter() {}
 };
 
-class CropFilter : BaseFilter {
+// Filter that maps every pixel on its own, regardless of its neighbors. The pipeline fuses runs
+// of point filters into a single sweep over the image.
+class PointFilter : public BaseFilter {
+public:
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    std::vector<TileStage> GetTileStages() const override;
+
+    bool NeedsBackBuffer() const override {
+        return false;
+    }
+
+    // Maps `count` consecutive pixels in place.
+    virtual void MapPixels(Color* pixels, size_t count) const = 0;
+};
+
+// Chain of point filters applied in one pass: each chunk of a row goes through the whole chain
+// while it is still in L1, so the image is read and written once however long the chain is.
+class FusedPointFilter : public PointFilter {
+public:
+    explicit FusedPointFilter(std::vector<PointFilter*> filters) : filters_(std::move(filters)) {}
+
+    void MapPixels(Color* pixels, size_t count) const override;
+
+    std::string Describe() const override;
+
+    ~FusedPointFilter() override;
+
+private:
+    static constexpr size_t kChunkSize = 256;
+
+    std::vector<PointFilter*> filters_;
+};
+
+// Point filter that runs every channel through the same curve. Runs of channel filters are
+// compiled by the pipeline into a ChannelLutFilter.
+class ChannelFilter : public PointFilter {
+public:
+    void MapPixels(Color* pixels, size_t count) const override;
+
+    virtual double MapChannel(double value) const = 0;
+
+    // Whether evaluating the curve is cheaper than a table lookup.
+    virtual bool IsCheap() const {
+        return false;
+    }
+};
+
+// Chain of channel filters compiled into a 256-entry table over 8-bit levels. Channels that are
+// still exactly on a level, as every pixel is right after loading, are mapped with one lookup;
+// any other value falls back to evaluating the chain. Both ways give the same result.
+class ChannelLutFilter : public PointFilter {
+public:
+    explicit ChannelLutFilter(std::vector<ChannelFilter*> filters);
+
+    void MapPixels(Color* pixels, size_t count) const override;
+
+    std::string Describe() const override;
+
+    ~ChannelLutFilter() override;
+
+private:
+    double MapChannel(double value) const;
+
+    std::vector<ChannelFilter*> filters_;
+    std::array<double, 256> table_;
+};
+
+// Chain of filters run tile by tile: each tile, grown by enough halo for every neighborhood filter
+// in the chain, goes through the whole chain while it is still in L2 before the next tile is
+// read. The chain then reads and writes the image once instead of once per filter, at the cost of
+// recomputing the halo. Every filter of the chain must have tile stages.
+class TiledFilter : public BaseFilter {
+public:
+    explicit TiledFilter(std::vector<BaseFilter*> filters);
+
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    std::vector<TileStage> GetTileStages() const override {
+        return stages_;
+    }
+
+    std::string Describe() const override;
+
+    ~TiledFilter() override;
+
+private:
+    // Two scratch tiles of this size, halo included, fit in a typical 512 KiB L2.
+    static constexpr int64_t kTileWidth = 128;
+    static constexpr int64_t kTileHeight = 64;
+
+    void RenderTile(const PixelView& image, const MutablePixelView& result, const Rect& tile) const;
+
+    std::vector<BaseFilter*> filters_;
+    std::vector<TileStage> stages_;
+    int64_t halo_x_ = 0;
+    int64_t halo_y_ = 0;
+};
+
+class CropFilter : public BaseFilter {
 public:
     CropFilter(uint32_t new_width, uint32_t new_height) : new_width_(new_width), new_height_(new_height) {}
 
-    void Apply(Bitmap& image) const override;
+    uint32_t GetNewWidth() const {
+        return new_width_;
+    }
+    uint32_t GetNewHeight() const {
+        return new_height_;
+    }
+
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    bool NeedsBackBuffer() const override {
+        return false;
+    }
+
+    size_t GetSweepCount() const override {
+        return 0;
+    }
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
 
@@ -23,61 +186,138 @@ private:
     uint32_t new_height_;
 };
 
-class GrayscaleFilter : BaseFilter {
+class GrayscaleFilter : public PointFilter {
+public:
+    void MapPixels(Color* pixels, size_t count) const override;
+
+    static double Luma(const Color& pixel) {
+        return 0.299 * pixel.R + 0.587 * pixel.G + 0.114 * pixel.B;
+    }
+
+    std::string Describe() const override;
+
+    static BaseFilter* Create(const FilterInfo& info);
+};
+
+class NegativeFilter : public ChannelFilter {
 public:
-    void Apply(Bitmap& image) const override;
+    double MapChannel(double value) const override {
+        return 1 - value;
+    }
+
+    bool IsCheap() const override {
+        return true;
+    }
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
 };
 
-class NegativeFilter : BaseFilter {
+class GammaFilter : public ChannelFilter {
 public:
-    void Apply(Bitmap& image) const override;
+    explicit GammaFilter(double gamma) : gamma_(gamma), inverse_gamma_(1 / gamma) {}
+
+    double MapChannel(double value) const override {
+        return std::pow(value, inverse_gamma_);
+    }
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
+
+private:
+    double gamma_;
+    double inverse_gamma_;
 };
 
-class SharpeningFilter : BaseFilter {
+class SharpeningFilter : public BaseFilter {
 public:
-    void Apply(Bitmap& image) const override;
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    std::vector<TileStage> GetTileStages() const override;
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
+
+private:
+    void Render(const PixelView& src, const MutablePixelView& dst, const Rect& out) const;
 };
 
-class EdgeDetectionFilter : BaseFilter {
+class EdgeDetectionFilter : public BaseFilter {
 public:
     EdgeDetectionFilter(double threshold) : threshold_(threshold) {}
 
-    void Apply(Bitmap& image) const override;
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    // Same as Apply, but keeps the result packed instead of expanding it to colors.
+    BitMask Detect(Bitmap& image) const {
+        FilterContext context;
+        return Detect(image, context);
+    }
+    BitMask Detect(Bitmap& image, FilterContext& context) const;
+
+    std::vector<TileStage> GetTileStages() const override;
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
 
 private:
+    // Calls store(x, y, is_edge) for every pixel of `out`.
+    template <typename Store>
+    void DetectEdges(const PixelView& src, const Rect& out, Store&& store) const;
+
+    void Render(const PixelView& src, const MutablePixelView& dst, const Rect& out) const;
+
     double threshold_;
 };
 
-class GaussianBlurFilter : BaseFilter {
+class GaussianBlurFilter : public BaseFilter {
 public:
     explicit GaussianBlurFilter(double sigma);
 
-    void Apply(Bitmap& image) const override;
+    double GetSigma() const {
+        return sigma_;
+    }
+
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    std::vector<TileStage> GetTileStages() const override;
+
+    size_t GetSweepCount() const override {
+        return 2;
+    }
 
     double GaussFunc(int32_t i) const;
-    Color CalcNewPixelHorizontal(Bitmap& image, uint32_t x, uint32_t y) const;
-    Color CalcNewPixelVertical(Bitmap& image, uint32_t x, uint32_t y) const;
+    std::vector<double> CalcWeights() const;
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
 
 private:
+    // One direction of the separable blur: taps are (i * step_x, i * step_y) for |i| <= radius.
+    void RenderPass(int32_t step_x, int32_t step_y, const PixelView& src, const MutablePixelView& dst,
+                    const Rect& out) const;
+
     double sigma_;
     int32_t radius_;
+    std::vector<double> weights_;
 };
 
-class PixelateFilter : BaseFilter {
+class PixelateFilter : public BaseFilter {
 public:
     PixelateFilter(double res_multiplier) : res_multiplier_(res_multiplier) {}
 
-    void Apply(Bitmap& image) const override;
+    using BaseFilter::Apply;
+    void Apply(Bitmap& image, FilterContext& context) const override;
+
+    std::string Describe() const override;
 
     static BaseFilter* Create(const FilterInfo& info);
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "bitmap.h"
+
+// Rectangle [left, right) x [top, bottom) in image coordinates.
+struct Rect {
+    int64_t left = 0;
+    int64_t top = 0;
+    int64_t right = 0;
+    int64_t bottom = 0;
+
+    int64_t GetWidth() const {
+        return right - left;
+    }
+    int64_t GetHeight() const {
+        return bottom - top;
+    }
+
+    // Grows the rectangle by the given margins, without leaving `bounds`.
+    Rect Expand(int64_t margin_x, int64_t margin_y, const Rect& bounds) const {
+        return Rect{std::max(bounds.left, left - margin_x), std::max(bounds.top, top - margin_y),
+                    std::min(bounds.right, right + margin_x), std::min(bounds.bottom, bottom + margin_y)};
+    }
+};
+
+// Window of an image's pixels stored row by row: image pixel (x, y) inside `window` lives at
+// data[(y - window.top) * stride + x - window.left]. Filters address views in image coordinates
+// only, so rendering one tile of an image works exactly like rendering all of it.
+template <typename T>
+class BasicPixelView {
+public:
+    BasicPixelView(T* data, int64_t stride, const Rect& window, int64_t image_width, int64_t image_height)
+        : data_(data), stride_(stride), window_(window), image_width_(image_width), image_height_(image_height) {}
+
+    // A mutable view converts to a read-only one.
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    BasicPixelView(const BasicPixelView<U>& other)
+        : BasicPixelView(other.GetData(), other.GetStride(), other.GetWindow(), other.GetImageWidth(),
+                         other.GetImageHeight()) {}
+
+    T& At(int64_t x, int64_t y) const {
+        return data_[(y - window_.top) * stride_ + x - window_.left];
+    }
+
+    // Image pixel closest to (x, y), which has to be inside the window.
+    T& AtClosest(int64_t x, int64_t y) const {
+        return At(std::max<int64_t>(0, std::min(image_width_ - 1, x)),
+                  std::max<int64_t>(0, std::min(image_height_ - 1, y)));
+    }
+
+    T* GetData() const {
+        return data_;
+    }
+    int64_t GetStride() const {
+        return stride_;
+    }
+    const Rect& GetWindow() const {
+        return window_;
+    }
+    int64_t GetImageWidth() const {
+        return image_width_;
+    }
+    int64_t GetImageHeight() const {
+        return image_height_;
+    }
+
+private:
+    T* data_;
+    int64_t stride_;
+    Rect window_;
+    int64_t image_width_;
+    int64_t image_height_;
+};
+
+using PixelView = BasicPixelView<const Color>;
+using MutablePixelView = BasicPixelView<Color>;
+
+// Copies the pixels of `rect`, which both views have to cover.
+inline void CopyPixels(const PixelView& src, const MutablePixelView& dst, const Rect& rect) {
+    for (int64_t y = rect.top; y < rect.bottom; ++y) {
+        std::copy(&src.At(rect.left, y), &src.At(rect.right, y), &dst.At(rect.left, y));
+    }
+}
+
+inline Rect ImageRect(const Bitmap& image) {
+    return Rect{0, 0, image.GetWidth(), image.GetHeight()};
+}
+
+// The visible pixels of the image.
+inline PixelView ViewPixels(const Bitmap& image) {
+    return PixelView(image.GetRow(0), image.GetStride(), ImageRect(image), image.GetWidth(), image.GetHeight());
+}
+
+// A buffer with the image's own layout, such as the context's back buffer.
+inline MutablePixelView ViewBuffer(std::vector<Color>& pixels, const Bitmap& image) {
+    return MutablePixelView(pixels.data(), image.GetStride(), ImageRect(image), image.GetWidth(), image.GetHeight());
+}
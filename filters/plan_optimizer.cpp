@@ -0,0 +1,59 @@
+#include "plan_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void PlanOptimizer::Optimize(std::vector<BaseFilter*>& filters) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i + 1 < filters.size() && !changed; ++i) {
+            changed = RewritePair(filters, i);
+        }
+    }
+}
+
+bool PlanOptimizer::RewritePair(std::vector<BaseFilter*>& filters, size_t i) {
+    BaseFilter* first = filters[i];
+    BaseFilter* second = filters[i + 1];
+
+    if (const auto* crop = dynamic_cast<const CropFilter*>(second)) {
+        if (const auto* previous_crop = dynamic_cast<const CropFilter*>(first)) {
+            filters[i] = new CropFilter(std::min(previous_crop->GetNewWidth(), crop->GetNewWidth()),
+                                        std::min(previous_crop->GetNewHeight(), crop->GetNewHeight()));
+            filters.erase(filters.begin() + i + 1);
+            delete first;
+            delete second;
+            return true;
+        }
+        if (dynamic_cast<const PointFilter*>(first)) {
+            std::swap(filters[i], filters[i + 1]);
+            return true;
+        }
+    }
+
+    if (dynamic_cast<const NegativeFilter*>(first) && dynamic_cast<const NegativeFilter*>(second)) {
+        filters.erase(filters.begin() + i, filters.begin() + i + 2);
+        delete first;
+        delete second;
+        return true;
+    }
+
+    if (dynamic_cast<const GrayscaleFilter*>(first) && dynamic_cast<const GrayscaleFilter*>(second)) {
+        filters.erase(filters.begin() + i + 1);
+        delete second;
+        return true;
+    }
+
+    const auto* first_blur = dynamic_cast<const GaussianBlurFilter*>(first);
+    const auto* second_blur = dynamic_cast<const GaussianBlurFilter*>(second);
+    if (first_blur && second_blur) {
+        filters[i] = new GaussianBlurFilter(std::hypot(first_blur->GetSigma(), second_blur->GetSigma()));
+        filters.erase(filters.begin() + i + 1);
+        delete first;
+        delete second;
+        return true;
+    }
+
+    return false;
+}
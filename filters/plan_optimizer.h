@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+#include "filters.h"
+
+// Rewrites a filter list into a cheaper one with the same visible result:
+//  - crops move in front of point filters and adjacent crops merge, so that the filters after
+//    them run on fewer pixels;
+//  - "-neg -neg" pairs are dropped and repeated "-gs" collapse into one;
+//  - consecutive blurs merge into one with sigma = sqrt(s1^2 + s2^2).
+// Filters that get rewritten away are deleted. The last three rules hold up to rounding and
+// kernel truncation only, which is why the pipeline optimizes on request.
+class PlanOptimizer {
+public:
+    static void Optimize(std::vector<BaseFilter*>& filters);
+
+private:
+    // Rewrites the adjacent filters at i and i + 1 if some rule applies, returns whether it did.
+    static bool RewritePair(std::vector<BaseFilter*>& filters, size_t i);
+};
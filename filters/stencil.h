@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include "bitmap.h"
+#include "pixel_view.h"
+
+// Neighborhood of a pixel close to the image border: every tap is clamped to the image bounds.
+class ClampedNeighborhood {
+public:
+    ClampedNeighborhood(const PixelView& pixels, int64_t x, int64_t y) : pixels_(pixels), x_(x), y_(y) {}
+
+    const Color& operator()(int32_t dx, int32_t dy) const {
+        return pixels_.AtClosest(x_ + dx, y_ + dy);
+    }
+
+private:
+    const PixelView& pixels_;
+    int64_t x_;
+    int64_t y_;
+};
+
+// Neighborhood of an interior pixel: taps are read straight from the pixel rows.
+class DirectNeighborhood {
+public:
+    DirectNeighborhood(const Color* center, int64_t stride) : center_(center), stride_(stride) {}
+
+    const Color& operator()(int32_t dx, int32_t dy) const {
+        return center_[dy * stride_ + dx];
+    }
+
+private:
+    const Color* center_;
+    int64_t stride_;
+};
+
+// Calls kernel(x, y, neighborhood) for every pixel of `out`, where neighborhood(dx, dy) returns the
+// source pixel at the given offset. The source view has to cover `out` grown by the radii. Only
+// pixels closer than radius_x / radius_y to the image border get the clamping neighborhood, the
+// interior is indexed directly.
+template <typename Kernel>
+void ForEachNeighborhood(const PixelView& src, int32_t radius_x, int32_t radius_y, const Rect& out,
+                         Kernel&& kernel) {
+    const int64_t width = src.GetImageWidth();
+    const int64_t height = src.GetImageHeight();
+    const int64_t stride = src.GetStride();
+
+    const int64_t inner_left = std::max<int64_t>(out.left, std::min<int64_t>(radius_x, out.right));
+    const int64_t inner_right = std::max<int64_t>(inner_left, std::min<int64_t>(out.right, width - radius_x));
+
+    for (int64_t y = out.top; y < out.bottom; ++y) {
+        if (y < radius_y || y >= height - radius_y) {
+            for (int64_t x = out.left; x < out.right; ++x) {
+                kernel(x, y, ClampedNeighborhood(src, x, y));
+            }
+            continue;
+        }
+
+        for (int64_t x = out.left; x < inner_left; ++x) {
+            kernel(x, y, ClampedNeighborhood(src, x, y));
+        }
+        for (int64_t x = inner_left; x < inner_right; ++x) {
+            kernel(x, y, DirectNeighborhood(&src.At(x, y), stride));
+        }
+        for (int64_t x = inner_right; x < out.right; ++x) {
+            kernel(x, y, ClampedNeighborhood(src, x, y));
+        }
+    }
+}
+
+// Neighborhood over a window of 2 * Radius + 1 row pointers, rows[Radius] being the current row.
+// The rows hold image columns from `left` on and are clamped by whoever builds the window;
+// Clamped also clamps taps to the image columns [0, width).
+template <typename T, int32_t Radius, bool Clamped>
+class RowWindowNeighborhood {
+public:
+    RowWindowNeighborhood(const T* const* rows, int64_t x, int64_t left, int64_t width)
+        : rows_(rows), x_(x), left_(left), width_(width) {}
+
+    const T& operator()(int32_t dx, int32_t dy) const {
+        if constexpr (Clamped) {
+            return rows_[dy + Radius][std::max<int64_t>(0, std::min<int64_t>(width_ - 1, x_ + dx)) - left_];
+        } else {
+            return rows_[dy + Radius][x_ + dx - left_];
+        }
+    }
+
+private:
+    const T* const* rows_;
+    int64_t x_;
+    int64_t left_;
+    int64_t width_;
+};
+
+// Calls kernel(x, neighborhood) for every x in [x_begin, x_end) of the current row of a row
+// window, peeling the first and last Radius image columns off the unchecked interior.
+template <int32_t Radius, typename T, typename Kernel>
+void ForEachInRowWindow(const T* const* rows, int64_t x_begin, int64_t x_end, int64_t left, int64_t width,
+                        Kernel&& kernel) {
+    const int64_t inner_left = std::max<int64_t>(x_begin, std::min<int64_t>(Radius, x_end));
+    const int64_t inner_right = std::max<int64_t>(inner_left, std::min<int64_t>(x_end, width - Radius));
+
+    for (int64_t x = x_begin; x < inner_left; ++x) {
+        kernel(x, RowWindowNeighborhood<T, Radius, true>(rows, x, left, width));
+    }
+    for (int64_t x = inner_left; x < inner_right; ++x) {
+        kernel(x, RowWindowNeighborhood<T, Radius, false>(rows, x, left, width));
+    }
+    for (int64_t x = inner_right; x < x_end; ++x) {
+        kernel(x, RowWindowNeighborhood<T, Radius, true>(rows, x, left, width));
+    }
+}
+
+// Square convolution kernel with weights known at compile time, listed row by row. Every tap is
+// unrolled into its own statement: zero taps are dropped, +1 / -1 taps become a plain add or
+// subtract, so the interior loop is a branch-free sequence of loads and adds.
+template <int32_t Size, int32_t... Weights>
+class StencilKernel {
+public:
+    static_assert(Size % 2 == 1, "Stencil kernel must have odd size");
+    static_assert(sizeof...(Weights) == Size * Size, "Stencil kernel must have Size * Size weights");
+
+    static constexpr int32_t kRadius = Size / 2;
+    static constexpr std::array<int32_t, Size * Size> kWeights = {Weights...};
+
+    // Weighted sum of channel(neighborhood(dx, dy)) over all taps, in row-major order.
+    template <typename Neighborhood, typename Channel>
+    static double Sum(const Neighborhood& pixels, Channel channel) {
+        return SumTaps(pixels, channel, std::make_index_sequence<Size * Size>{});
+    }
+
+    template <typename Neighborhood>
+    static Color Sum(const Neighborhood& pixels) {
+        return Color(Sum(pixels, [](const Color& pixel) { return pixel.R; }),
+                     Sum(pixels, [](const Color& pixel) { return pixel.G; }),
+                     Sum(pixels, [](const Color& pixel) { return pixel.B; }));
+    }
+
+private:
+    template <typename Neighborhood, typename Channel, size_t... Taps>
+    static double SumTaps(const Neighborhood& pixels, Channel channel, std::index_sequence<Taps...>) {
+        double sum = 0;
+        (AddTap<Taps>(sum, pixels, channel), ...);
+        return sum;
+    }
+
+    template <size_t Tap, typename Neighborhood, typename Channel>
+    static void AddTap(double& sum, const Neighborhood& pixels, Channel channel) {
+        constexpr int32_t weight = kWeights[Tap];
+        constexpr int32_t dx = static_cast<int32_t>(Tap % Size) - kRadius;
+        constexpr int32_t dy = static_cast<int32_t>(Tap / Size) - kRadius;
+
+        if constexpr (weight == 1) {
+            sum += channel(pixels(dx, dy));
+        } else if constexpr (weight == -1) {
+            sum -= channel(pixels(dx, dy));
+        } else if constexpr (weight != 0) {
+            sum += channel(pixels(dx, dy)) * weight;
+        }
+    }
+};
+
+// Convolves the pixels of `out` with a compile-time kernel and hands every raw sum to
+// store(x, y, sum).
+template <typename Kernel, typename Store>
+void ApplyStencil(const PixelView& src, const Rect& out, Store&& store) {
+    const int32_t radius = Kernel::kRadius;
+    ForEachNeighborhood(src, radius, radius, out, [&](int64_t x, int64_t y, const auto& pixels) {
+        store(x, y, Kernel::Sum(pixels));
+    });
+}
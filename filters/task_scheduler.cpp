@@ -0,0 +1,204 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+static thread_local const TaskScheduler* current_scheduler = nullptr;
+static thread_local size_t current_slot = 0;
+// Time the running task has spent so far in Wait, including the tasks Wait ran meanwhile, which
+// count as busy time of their own.
+static thread_local uint64_t task_wait_nanoseconds = 0;
+
+TaskScheduler::TaskScheduler(size_t thread_count) : start_time_(std::chrono::steady_clock::now()) {
+    thread_count = std::max<size_t>(1, thread_count);
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        slots_.push_back(std::make_unique<Slot>());
+    }
+    for (size_t i = 1; i < thread_count; ++i) {
+        workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+size_t TaskScheduler::CurrentSlot() const {
+    return current_scheduler == this ? current_slot : 0;
+}
+
+void TaskScheduler::Submit(TaskGroup& group, std::function<void()> task) {
+    ++group.pending_;
+    ++group.queued_;
+
+    Slot& slot = *slots_[CurrentSlot()];
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.tasks.push_back(Task{std::move(task), &group});
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++queued_tasks_;
+    }
+    // All, since a thread waiting for another group would not take the task.
+    wake_.notify_all();
+}
+
+bool TaskScheduler::RunTask(size_t slot_index, const TaskGroup* group) {
+    Task task;
+    bool found = false;
+    bool stolen = false;
+
+    // Own tasks from the back, stolen ones from the front, skipping tasks of other groups.
+    auto take = [&](std::deque<Task>& tasks, bool from_back) {
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            auto it = from_back ? tasks.end() - 1 - i : tasks.begin() + i;
+            if (!group || it->group == group) {
+                task = std::move(*it);
+                tasks.erase(it);
+                return true;
+            }
+        }
+        return false;
+    };
+
+    {
+        Slot& own = *slots_[slot_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        found = take(own.tasks, true);
+    }
+
+    for (size_t i = 1; !found && i < slots_.size(); ++i) {
+        Slot& victim = *slots_[(slot_index + i) % slots_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        found = stolen = take(victim.tasks, false);
+    }
+
+    if (!found) {
+        return false;
+    }
+    --queued_tasks_;
+    --task.group->queued_;
+
+    const uint64_t outer_wait_nanoseconds = task_wait_nanoseconds;
+    task_wait_nanoseconds = 0;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        task.func();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(task.group->error_mutex_);
+        if (!task.group->error_) {
+            task.group->error_ = std::current_exception();
+        }
+    }
+    auto duration = std::chrono::steady_clock::now() - start;
+    const uint64_t wall_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    const uint64_t busy_nanoseconds = wall_nanoseconds - std::min(wall_nanoseconds, task_wait_nanoseconds);
+    task_wait_nanoseconds = outer_wait_nanoseconds;
+
+    Slot& slot = *slots_[slot_index];
+    slot.busy_nanoseconds += busy_nanoseconds;
+    ++slot.task_count;
+    if (stolen) {
+        ++slot.stolen_count;
+    }
+
+    if (--task.group->pending_ == 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        wake_.notify_all();
+    }
+
+    return true;
+}
+
+void TaskScheduler::Wait(TaskGroup& group) {
+    const size_t slot = CurrentSlot();
+    const auto start = std::chrono::steady_clock::now();
+
+    while (group.pending_ > 0) {
+        if (RunTask(slot, &group)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [&] { return group.pending_ == 0 || group.queued_ > 0; });
+    }
+    task_wait_nanoseconds +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (group.error_) {
+        std::rethrow_exception(group.error_);
+    }
+}
+
+void TaskScheduler::ParallelFor(uint32_t begin, uint32_t end, const std::function<void(uint32_t, uint32_t)>& func) {
+    if (begin >= end) {
+        return;
+    }
+    if (workers_.empty()) {
+        func(begin, end);
+        return;
+    }
+
+    const uint32_t max_tiles = static_cast<uint32_t>(GetThreadCount() * 8);
+    const uint32_t tile_size = std::max<uint32_t>(1, (end - begin + max_tiles - 1) / max_tiles);
+
+    TaskGroup group;
+    for (uint32_t tile_begin = begin; tile_begin < end; tile_begin += tile_size) {
+        uint32_t tile_end = std::min(tile_begin + tile_size, end);
+        Submit(group, [&func, tile_begin, tile_end] { func(tile_begin, tile_end); });
+    }
+    Wait(group);
+}
+
+void TaskScheduler::WorkerLoop(size_t slot) {
+    current_scheduler = this;
+    current_slot = slot;
+
+    while (true) {
+        if (RunTask(slot)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || queued_tasks_ > 0; });
+        if (stopping_ && queued_tasks_ <= 0) {
+            return;
+        }
+    }
+}
+
+std::vector<TaskScheduler::ThreadStats> TaskScheduler::GetThreadStats() const {
+    std::vector<ThreadStats> stats;
+    for (const auto& slot : slots_) {
+        stats.push_back(ThreadStats{slot->busy_nanoseconds * 1e-9, slot->task_count, slot->stolen_count});
+    }
+    return stats;
+}
+
+double TaskScheduler::GetElapsedSeconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count();
+}
+
+void TaskScheduler::ReportUtilization(std::ostream& stream) const {
+    const double elapsed = GetElapsedSeconds();
+    const auto stats = GetThreadStats();
+
+    stream << "Scheduler utilization over " << std::fixed << std::setprecision(3) << elapsed << " s:" << std::endl;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        double busy_percent = elapsed > 0 ? 100 * stats[i].busy_seconds / elapsed : 0;
+        stream << "  thread " << std::setw(3) << i << (i == 0 ? " (caller)" : "         ") << std::setw(7)
+               << std::setprecision(1) << busy_percent << "% busy, " << stats[i].tasks << " tasks, "
+               << stats[i].stolen_tasks << " stolen" << std::endl;
+    }
+    stream << std::defaultfloat;
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
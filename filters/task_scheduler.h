@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler. Every thread has its own deque of tasks: it pushes and pops at the
+// back, so it keeps working on the tiles it just split off, while idle threads steal from the
+// front of the others. Tasks may submit and wait for more tasks, which is how a whole image job
+// and the tiles of its filters share the same threads. A thread waiting for a group only runs
+// tasks of that group, so a stage never runs another image job nested inside it.
+//
+// A scheduler of N threads starts N - 1 workers; any other thread that submits or waits works
+// on tasks through the extra "caller" slot.
+class TaskScheduler {
+public:
+    // Set of tasks that can be waited for together. The first exception thrown by one of them is
+    // rethrown by Wait.
+    class TaskGroup {
+    public:
+        TaskGroup() = default;
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+    private:
+        friend class TaskScheduler;
+
+        std::atomic<size_t> pending_ = 0;
+        // Tasks of the group still in a deque, which its waiters may take.
+        std::atomic<size_t> queued_ = 0;
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+
+    struct ThreadStats {
+        double busy_seconds = 0;
+        uint64_t tasks = 0;
+        uint64_t stolen_tasks = 0;
+    };
+
+    explicit TaskScheduler(size_t thread_count);
+
+    size_t GetThreadCount() const {
+        return workers_.size() + 1;
+    }
+
+    void Submit(TaskGroup& group, std::function<void()> task);
+
+    // Runs queued tasks of the group until every task of the group has finished.
+    void Wait(TaskGroup& group);
+
+    // Calls func(tile_begin, tile_end) for contiguous tiles covering [begin, end) and returns once
+    // all of them are done. Tiles are small enough for idle threads to even out uneven ones.
+    void ParallelFor(uint32_t begin, uint32_t end, const std::function<void(uint32_t, uint32_t)>& func);
+
+    // Per thread, the caller slot first. Busy time is measured since construction; a task waiting
+    // for others is not busy meanwhile, so nested tasks are counted once.
+    std::vector<ThreadStats> GetThreadStats() const;
+    double GetElapsedSeconds() const;
+
+    void ReportUtilization(std::ostream& stream) const;
+
+    ~TaskScheduler();
+
+private:
+    struct Task {
+        std::function<void()> func;
+        TaskGroup* group;
+    };
+
+    struct Slot {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+
+        std::atomic<uint64_t> busy_nanoseconds = 0;
+        std::atomic<uint64_t> task_count = 0;
+        std::atomic<uint64_t> stolen_count = 0;
+    };
+
+    // Slot of the calling thread: its worker slot, or the shared caller slot 0.
+    size_t CurrentSlot() const;
+
+    // Pops a task from the slot's own deque or steals one, runs it and returns true; returns
+    // false if every deque is empty. Given a group, only takes tasks of that group.
+    bool RunTask(size_t slot, const TaskGroup* group = nullptr);
+
+    void WorkerLoop(size_t slot);
+
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<std::thread> workers_;
+    std::chrono::steady_clock::time_point start_time_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<int64_t> queued_tasks_ = 0;
+    bool stopping_ = false;
+};
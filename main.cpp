@@ -7,14 +7,14 @@ int main(int argc, const char* argv[]) {
     App app(argc, argv);
 
     try {
-        app.Run();
+        return app.Run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
     } catch (...) {
         std::cerr << "Unexpected error occurred!" << std::endl;
     }
 
-    return 0;
+    return 1;
 }
 
 
@@ -1,20 +1,76 @@
 #include "catch.hpp"
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 #include <string_view>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "core/parser.h"
+#include "core/perf_counters.h"
 #include "core/app.h"
+#include "core/batch.h"
+#include "core/hash.h"
+#include "core/image_difference.h"
+#include "core/image_generator.h"
+#include "core/result_cache.h"
+#include "core/server.h"
+#include "core/stats.h"
+#include "core/trace.h"
 #include "core/bitmap.h"
+#include "core/bitmask.h"
 #include "core/utils.h"
 #include "filters/filter_pipeline.h"
 #include "filters/filters.h"
+#include "filters/stencil.h"
+#include "filters/task_scheduler.h"
+#include "exceptions/app_error.h"
 
 using namespace std::literals::string_view_literals;
 
-std::string path1 = "examples/example.bmp";
-std::string path2 = "examples/output.bmp";
+// Files the tests write, in a directory of their own under the system temporary directory.
+static std::string TestPath(std::string_view name) {
+    static const std::filesystem::path directory = [] {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "bmp_processor_tests";
+        std::filesystem::create_directories(path);
+        return path;
+    }();
+    return (directory / name).string();
+}
+
+// Input image of an odd width, so that rows are padded.
+static std::string GenerateTestImage(std::string_view name) {
+    std::string path = TestPath(name);
+    ImageGenerator(157, 123, ImageGenerator::Pattern::Noise, 1).WriteToFile(path);
+    return path;
+}
+
+// Requires image to be within the given distance of reference, e.g. a fast path of the exact
+// implementation, and prints how far it is otherwise.
+static void RequireClose(const Bitmap& image, const Bitmap& reference, double max_abs_error, double min_psnr = 0,
+                         double min_ssim = 0) {
+    ImageDifference difference = ImageDifference::Compute(image, reference);
+    std::ostringstream report;
+    difference.Report(report);
+    INFO(report.str());
+    REQUIRE(difference.max_abs_error <= max_abs_error);
+    REQUIRE(difference.psnr >= min_psnr);
+    REQUIRE(difference.ssim >= min_ssim);
+}
+
+std::string path1 = GenerateTestImage("example.bmp");
+std::string path2 = GenerateTestImage("output.bmp");
 
 TEST_CASE("FilterParser") {
     size_t argc = 8;
@@ -38,6 +94,44 @@ TEST_CASE("FilterParser") {
     REQUIRE(parser.ParseOutputPath() == argv[2]);
 }
 
+TEST_CASE("FilterParserOptions") {
+    size_t argc = 7;
+    const char* argv[] = {"image_processor", "--bpp=1", "input.bmp", "output.bmp", "-edge", "0.1", "--dry"};
+
+    FiltersParser parser(argc, argv);
+
+    std::vector<FilterInfo> parsed;
+    FilterInfo edge("edge");
+    edge.AddParam("0.1");
+    parsed.push_back(edge);
+
+    REQUIRE(parser.ParseFilters() == parsed);
+    REQUIRE(parser.ParseInputPath() == argv[2]);
+    REQUIRE(parser.ParseOutputPath() == argv[3]);
+    REQUIRE(parser.ParseOptions() == FiltersParser::Options{{"bpp"sv, "1"sv}, {"dry"sv, ""sv}});
+}
+
+TEST_CASE("FilterParserExplain") {
+    // --explain needs no paths, but still accepts them.
+    const char* argv[] = {"image_processor", "--explain", "-gs", "-blur", "2"};
+    FiltersParser parser(5, argv);
+    FilterInfo blur("blur");
+    blur.AddParam("2");
+    REQUIRE(!parser.HasPaths());
+    REQUIRE(parser.ParseFilters() == std::vector<FilterInfo>{FilterInfo("gs"), blur});
+
+    std::vector<FilterInfo> parsed = parser.ParseFilters();
+    FiltersPipeline pipeline(parsed);
+    std::ostringstream plan;
+    pipeline.Explain(plan);
+    REQUIRE(plan.str() == "1. -gs\n2. -blur 2\n");
+
+    const char* path_argv[] = {"image_processor", "input.bmp", "output.bmp", "--explain", "-gs"};
+    FiltersParser path_parser(5, path_argv);
+    REQUIRE(path_parser.HasPaths());
+    REQUIRE(path_parser.ParseFilters() == std::vector<FilterInfo>{FilterInfo("gs")});
+}
+
 TEST_CASE("Bitmap") {
     Bitmap img1;
     Bitmap img2;
@@ -58,9 +152,842 @@ TEST_CASE("Bitmap") {
     REQUIRE(img1.GetHeight() == img2.GetHeight());
 }
 
+TEST_CASE("ImageGenerator") {
+    auto write = [](const ImageGenerator& generator, uint32_t bits_per_pixel) {
+        std::stringstream stream;
+        generator.Write(stream, bits_per_pixel);
+        return stream.str();
+    };
+
+    ImageGenerator noise(157, 123, ImageGenerator::Pattern::Noise, 1);
+    REQUIRE(write(noise, 24) == write(ImageGenerator(157, 123, ImageGenerator::Pattern::Noise, 1), 24));
+    REQUIRE(write(noise, 24) != write(ImageGenerator(157, 123, ImageGenerator::Pattern::Noise, 2), 24));
+
+    Bitmap image = ImageGenerator(157, 123, ImageGenerator::ParsePattern("checkerboard")).Generate();
+    REQUIRE(image.GetWidth() == 157);
+    REQUIRE(image.GetHeight() == 123);
+    REQUIRE(image.GetPixel(0, 0) == Color(1, 1, 1));
+    REQUIRE(image.GetPixel(ImageGenerator::kCellSize, 0) == Color(0, 0, 0));
+    REQUIRE(image.GetPixel(ImageGenerator::kCellSize, ImageGenerator::kCellSize) == Color(1, 1, 1));
+
+    image = ImageGenerator(157, 123, ImageGenerator::Pattern::Gradient).Generate();
+    REQUIRE(image.GetPixel(0, 0) == Color(0, 0, 0));
+    REQUIRE(image.GetPixel(156, 122) == Color(1, 1, 1));
+
+    std::string mask = write(ImageGenerator(157, 123, ImageGenerator::Pattern::Edges), 1);
+    Bitmap::BMPHeader bmp_header;
+    Bitmap::DIBHeader dib_header;
+    std::memcpy(&bmp_header, mask.data(), sizeof(bmp_header));
+    std::memcpy(&dib_header, mask.data() + sizeof(bmp_header), sizeof(dib_header));
+    REQUIRE(bmp_header.file_size == mask.size());
+    REQUIRE(dib_header.bits_per_pixel == 1);
+    REQUIRE(dib_header.colors_in_color_table == 2);
+    REQUIRE(dib_header.image_size == 20 * 123);
+
+    REQUIRE_THROWS_AS(ImageGenerator::ParsePattern("stripes"), AppError);
+    REQUIRE_THROWS_AS(write(noise, 8), AppError);
+    REQUIRE_THROWS_AS(write(ImageGenerator(100000, 100000, ImageGenerator::Pattern::Noise), 24), AppError);
+}
+
+TEST_CASE("ImageDifference") {
+    Bitmap image;
+    Bitmap reference;
+    image.LoadFromBMP(path1);
+    reference.LoadFromBMP(path1);
+
+    ImageDifference difference = ImageDifference::Compute(image, reference);
+    REQUIRE(difference.max_abs_error == 0);
+    REQUIRE(std::isinf(difference.psnr));
+    REQUIRE(difference.ssim == Approx(1));
+
+    for (uint32_t y = 0; y < image.GetHeight(); ++y) {
+        for (uint32_t x = 0; x < image.GetWidth(); ++x) {
+            Color& pixel = image.GetPixel(x, y);
+            pixel.Set(pixel.R * 0.98 + 0.01, pixel.G * 0.98 + 0.01, pixel.B * 0.98 + 0.01);
+        }
+    }
+    image.GetPixel(20, 10).G += 0.5;
+    difference = ImageDifference::Compute(image, reference);
+    REQUIRE(difference.max_abs_error > 0.49);
+    REQUIRE(difference.max_error_x == 20);
+    REQUIRE(difference.max_error_y == 10);
+    REQUIRE(difference.psnr > 30);
+    REQUIRE(difference.psnr < 45);
+    REQUIRE(difference.ssim > 0.95);
+    REQUIRE(difference.ssim < 1);
+    RequireClose(image, reference, 0.51, 30, 0.95);
+
+    NegativeFilter().Apply(image);
+    REQUIRE(ImageDifference::Compute(image, reference).ssim < 0);
+
+    CropFilter(100, 100).Apply(image);
+    REQUIRE_THROWS_AS(ImageDifference::Compute(image, reference), AppError);
+}
+
 TEST_CASE("Utils") {
     REQUIRE(SVToType<uint32_t>("15"sv) == 15);
     REQUIRE(SVToType<double>("0.666"sv) == 0.666);
+    REQUIRE_THROWS_AS(SVToType<uint32_t>("x"sv), AppError);
+    REQUIRE_THROWS_AS(SVToType<uint32_t>("4294967296"sv), AppError);
+    REQUIRE(SVToByteSize("512M"sv) == size_t(512) << 20);
+    REQUIRE(SVToByteSize("17179869183G"sv) == size_t(17179869183) << 30);
+    REQUIRE_THROWS_AS(SVToByteSize("17179869184G"sv), AppError);
+    REQUIRE_THROWS_AS(SVToByteSize("18446744073709551615K"sv), AppError);
+}
+
+TEST_CASE("EdgeMask") {
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+
+    EdgeDetectionFilter filter(0.05);
+    BitMask edges = filter.Detect(img1);
+    filter.Apply(img2);
+
+    REQUIRE(edges.GetWidth() == img2.GetWidth());
+    REQUIRE(edges.GetHeight() == img2.GetHeight());
+
+    bool matches = true;
+    for (uint32_t y = 0; y < img2.GetHeight(); ++y) {
+        for (uint32_t x = 0; x < img2.GetWidth(); ++x) {
+            matches = matches && edges.Get(x, y) == (img2.GetPixel(x, y) == Color(1, 1, 1));
+        }
+    }
+    REQUIRE(matches);
+}
+
+TEST_CASE("EdgeDetectionReference") {
+    // Gray 0.2 with a brighter center, a red corner and a green corner. By the definition of
+    // -edge, grayscale then 4 * center minus the four neighbors, borders repeated, clamped:
+    //   center:       4 * 0.6 - 4 * 0.2 = 1.6, clamped to 1, an edge;
+    //   red corner:   luma 0.299, 2 * 0.299 - 2 * 0.2 = 0.198, below 0.25;
+    //   green corner: luma 0.587, 2 * 0.587 - 2 * 0.2 = 0.774, an edge;
+    // and every other pixel is at most 0, e.g. 4 * 0.2 - 3 * 0.2 - 0.6 next to the center.
+    Bitmap image = ImageGenerator(5, 5, ImageGenerator::Pattern::Checkerboard).Generate();
+    for (uint32_t y = 0; y < 5; ++y) {
+        for (uint32_t x = 0; x < 5; ++x) {
+            image.GetPixel(x, y).Set(0.2, 0.2, 0.2);
+        }
+    }
+    image.GetPixel(2, 2).Set(0.6, 0.6, 0.6);
+    image.GetPixel(0, 0).Set(1, 0, 0);
+    image.GetPixel(0, 4).Set(0, 1, 0);
+
+    auto is_edge = [](uint32_t x, uint32_t y) { return (x == 2 && y == 2) || (x == 0 && y == 4); };
+
+    Bitmap untiled = image;
+    EdgeDetectionFilter(0.25).Apply(untiled);
+    Bitmap tiled = image;
+    TiledFilter({new EdgeDetectionFilter(0.25)}).Apply(tiled);
+    Bitmap source = image;
+    BitMask mask = EdgeDetectionFilter(0.25).Detect(source);
+
+    for (uint32_t y = 0; y < 5; ++y) {
+        for (uint32_t x = 0; x < 5; ++x) {
+            Color expected = is_edge(x, y) ? Color(1, 1, 1) : Color(0, 0, 0);
+            REQUIRE(untiled.GetPixel(x, y) == expected);
+            REQUIRE(tiled.GetPixel(x, y) == expected);
+            REQUIRE(mask.Get(x, y) == is_edge(x, y));
+        }
+    }
+}
+
+TEST_CASE("PixelateFilter") {
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+
+    PixelateFilter(1).Apply(img1);
+    REQUIRE(img1 == img2);
+
+    uint32_t width = img2.GetWidth();
+    CropFilter(width, 1).Apply(img2);
+    PixelateFilter(0.3).Apply(img2);
+    REQUIRE(img2.GetWidth() == static_cast<uint32_t>(std::round(width * 0.3)));
+    REQUIRE(img2.GetHeight() == 1);
+
+    Color first_block(0, 0, 0);
+    uint32_t block_width = width / img2.GetWidth();
+    for (uint32_t x = 0; x < block_width; ++x) {
+        first_block.R += img1.GetPixel(x, 0).R / block_width;
+    }
+    REQUIRE(std::abs(img2.GetPixel(0, 0).R - first_block.R) < 1e-12);
+}
+
+TEST_CASE("StencilKernel") {
+    using Kernel = StencilKernel<3,
+         1, 0, -1,
+         2, 0, -2,
+         1, 0, -1>;
+    auto pixels = [](int32_t dx, int32_t dy) { return static_cast<double>(10 * dy + dx); };
+    auto value = [](double pixel) { return pixel; };
+
+    REQUIRE(Kernel::kRadius == 1);
+    REQUIRE(Kernel::Sum(pixels, value) == -8);
+}
+
+TEST_CASE("NeighborhoodBorders") {
+    // Columns rising left to right, the bottom row black. Borders repeat the edge pixels, so the
+    // top row must not see the bottom one, as it did when y - 1 wrapped around.
+    Bitmap image = ImageGenerator(64, 4, ImageGenerator::Pattern::Checkerboard).Generate();
+    for (uint32_t y = 0; y < 4; ++y) {
+        for (uint32_t x = 0; x < 64; ++x) {
+            double value = y == 3 ? 0 : 0.25 + x / 256.0;
+            image.GetPixel(x, y).Set(value, value, value);
+        }
+    }
+    Bitmap source = image;
+
+    SharpeningFilter().Apply(image);
+    REQUIRE(image.GetWidth() == 64);
+    REQUIRE(image.GetHeight() == 4);
+    for (uint32_t x = 1; x < 63; ++x) {
+        REQUIRE(std::abs(image.GetPixel(x, 0).R - source.GetPixel(x, 0).R) < 1e-12);
+    }
+    REQUIRE(std::abs(image.GetPixel(0, 0).R - (0.25 - 1 / 256.0)) < 1e-12);
+
+    // A blur of an image many times wider than high keeps the size and never mixes the top row
+    // with the bottom one.
+    image = source;
+    GaussianBlurFilter(1).Apply(image);
+    REQUIRE(image.GetWidth() == 64);
+    REQUIRE(image.GetHeight() == 4);
+    REQUIRE(image.GetPixel(32, 0).R > image.GetPixel(32, 1).R);
+
+    FilterInfo blur("blur"sv);
+    blur.AddParam("-1"sv);
+    FilterInfo zero_blur("blur"sv);
+    zero_blur.AddParam("0"sv);
+    std::vector<FilterInfo> negative_infos = {blur};
+    std::vector<FilterInfo> zero_infos = {zero_blur};
+    REQUIRE_THROWS_AS(FiltersPipeline(negative_infos), AppError);
+    REQUIRE_THROWS_AS(FiltersPipeline(zero_infos), AppError);
+}
+
+TEST_CASE("PixelateParams") {
+    for (std::string_view multiplier : {"nan"sv, "0"sv, "-0.5"sv, "1.5"sv}) {
+        FilterInfo pixelate("pixelate"sv);
+        pixelate.AddParam(multiplier);
+        std::vector<FilterInfo> infos = {pixelate};
+        REQUIRE_THROWS_AS(FiltersPipeline(infos), AppError);
+    }
+
+    FilterInfo pixelate("pixelate"sv);
+    pixelate.AddParam("1"sv);
+    std::vector<FilterInfo> infos = {pixelate};
+    Bitmap image;
+    image.LoadFromBMP(path1);
+    Bitmap reference = image;
+    FiltersPipeline(infos).Apply(image);
+    REQUIRE(image == reference);
+}
+
+TEST_CASE("ChannelLutFilter") {
+    FilterInfo gs("gs"sv);
+    FilterInfo neg("neg"sv);
+    FilterInfo gamma("gamma"sv);
+    gamma.AddParam("2.2"sv);
+    std::vector<FilterInfo> infos = {gamma, neg, gs, gamma, neg};
+
+    FiltersPipeline pipeline(infos);
+
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+
+    GammaFilter(2.2).Apply(img1);
+    NegativeFilter().Apply(img1);
+    GrayscaleFilter().Apply(img1);
+    GammaFilter(2.2).Apply(img1);
+    NegativeFilter().Apply(img1);
+
+    pipeline.Apply(img2);
+
+    REQUIRE(img1 == img2);
+}
+
+TEST_CASE("FusedPointFilter") {
+    FilterInfo gs("gs"sv);
+    FilterInfo neg("neg"sv);
+    FilterInfo gamma("gamma"sv);
+    gamma.AddParam("2"sv);
+    std::vector<FilterInfo> infos = {gs, neg, gamma};
+
+    FiltersPipeline pipeline(infos);
+    std::ostringstream plan;
+    pipeline.Explain(plan);
+    REQUIRE(plan.str() == "1. fused(-gs lut(-neg -gamma 2))\n");
+
+    Bitmap reference;
+    reference.LoadFromBMP(path1);
+    GrayscaleFilter().Apply(reference);
+    NegativeFilter().Apply(reference);
+    GammaFilter(2).Apply(reference);
+
+    Bitmap image;
+    image.LoadFromBMP(path1);
+    pipeline.Apply(image);
+    RequireClose(image, reference, 1e-12, 200, 0.9999);
+
+    image.LoadFromBMP(path1);
+    FusedPointFilter({new GrayscaleFilter(), new NegativeFilter(), new GammaFilter(2)}).Apply(image);
+    RequireClose(image, reference, 1e-12, 200, 0.9999);
+}
+
+TEST_CASE("PlanOptimizer") {
+    FilterInfo crop("crop"sv);
+    crop.AddParam("100"sv);
+    crop.AddParam("80"sv);
+    FilterInfo small_crop("crop"sv);
+    small_crop.AddParam("120"sv);
+    small_crop.AddParam("50"sv);
+    FilterInfo gs("gs"sv);
+    FilterInfo neg("neg"sv);
+    FilterInfo blur3("blur"sv);
+    blur3.AddParam("3"sv);
+    FilterInfo blur4("blur"sv);
+    blur4.AddParam("4"sv);
+    std::vector<FilterInfo> infos = {gs, neg, neg, gs, crop, blur3, blur4, neg, small_crop};
+
+    PipelineOptions options;
+    options.optimize = true;
+
+    FiltersPipeline pipeline(infos, options);
+
+    std::ostringstream plan;
+    pipeline.Explain(plan);
+    REQUIRE(plan.str() == "1. -crop 100 80\n2. -gs\n3. -blur 5\n4. -crop 120 50\n5. -neg\n");
+
+    std::vector<FilterInfo> pushdown_infos = {gs, neg, crop, blur3, neg, small_crop};
+    FiltersPipeline pushdown_pipeline(pushdown_infos, options);
+
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+
+    GrayscaleFilter().Apply(img1);
+    NegativeFilter().Apply(img1);
+    CropFilter(100, 80).Apply(img1);
+    GaussianBlurFilter(3).Apply(img1);
+    NegativeFilter().Apply(img1);
+    CropFilter(120, 50).Apply(img1);
+
+    pushdown_pipeline.Apply(img2);
+
+    REQUIRE(img1 == img2);
+
+    // Two blurs merged into one are equal up to rounding, and up to clamping near the borders.
+    std::vector<FilterInfo> blur_infos = {blur3, blur4};
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+    GaussianBlurFilter(3).Apply(img1);
+    GaussianBlurFilter(4).Apply(img1);
+    FiltersPipeline(blur_infos, options).Apply(img2);
+    RequireClose(img2, img1, 0.1, 45, 0.99);
+}
+
+TEST_CASE("TaskScheduler") {
+    TaskScheduler scheduler(4);
+
+    std::atomic<uint64_t> sum = 0;
+    TaskScheduler::TaskGroup jobs;
+    for (uint32_t job = 0; job < 16; ++job) {
+        scheduler.Submit(jobs, [&] {
+            scheduler.ParallelFor(0, 1000, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    sum += i;
+                }
+            });
+        });
+    }
+    scheduler.Wait(jobs);
+    REQUIRE(sum == 16 * 999 * 1000 / 2);
+
+    TaskScheduler::TaskGroup failing;
+    scheduler.Submit(failing, [] { throw AppError(AppError::InputFileIsNotOpen); });
+    REQUIRE_THROWS_AS(scheduler.Wait(failing), AppError);
+
+    uint64_t tasks = 0;
+    for (const auto& stats : scheduler.GetThreadStats()) {
+        tasks += stats.tasks;
+    }
+    REQUIRE(tasks >= 17);
+    REQUIRE(scheduler.GetThreadStats().size() == 4);
+}
+
+TEST_CASE("TaskSchedulerNestedBusyTime") {
+    // The outer task runs the inner one itself while it waits; the sleep is busy time once.
+    TaskScheduler scheduler(1);
+    TaskScheduler::TaskGroup outer;
+    scheduler.Submit(outer, [&scheduler] {
+        TaskScheduler::TaskGroup inner;
+        scheduler.Submit(inner, [] { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+        scheduler.Wait(inner);
+    });
+    scheduler.Wait(outer);
+
+    const auto stats = scheduler.GetThreadStats();
+    REQUIRE(stats[0].tasks == 2);
+    REQUIRE(stats[0].busy_seconds >= 0.05);
+    REQUIRE(stats[0].busy_seconds <= scheduler.GetElapsedSeconds());
+}
+
+TEST_CASE("TaskSchedulerWaitRunsOwnGroup") {
+    // A sibling queued after the inner task must not run nested inside the outer one's Wait.
+    TaskScheduler scheduler(1);
+    TaskScheduler::TaskGroup outer;
+    bool outer_running = false;
+    bool sibling_nested = true;
+    scheduler.Submit(outer, [&] {
+        outer_running = true;
+        TaskScheduler::TaskGroup inner;
+        scheduler.Submit(inner, [] {});
+        scheduler.Submit(outer, [&] { sibling_nested = outer_running; });
+        scheduler.Wait(inner);
+        outer_running = false;
+    });
+    scheduler.Wait(outer);
+
+    REQUIRE(!sibling_nested);
+    REQUIRE(scheduler.GetThreadStats()[0].tasks == 3);
+}
+
+TEST_CASE("ParallelPipeline") {
+    FilterInfo sharp("sharp"sv);
+    FilterInfo edge("edge"sv);
+    edge.AddParam("0.05"sv);
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1.5"sv);
+    FilterInfo pixelate("pixelate"sv);
+    pixelate.AddParam("0.4"sv);
+    FilterInfo gs("gs"sv);
+    std::vector<FilterInfo> infos = {sharp, blur, gs, pixelate, edge};
+
+    PipelineOptions serial_options;
+    serial_options.threads = 1;
+    PipelineOptions parallel_options;
+    parallel_options.threads = 4;
+
+    FiltersPipeline serial_pipeline(infos, serial_options);
+    FiltersPipeline parallel_pipeline(infos, parallel_options);
+
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+
+    serial_pipeline.Apply(img1);
+    parallel_pipeline.Apply(img2);
+
+    REQUIRE(img1 == img2);
+}
+
+TEST_CASE("TiledPipeline") {
+    FilterInfo neg("neg"sv);
+    FilterInfo sharp("sharp"sv);
+    FilterInfo edge("edge"sv);
+    edge.AddParam("0.05"sv);
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1.5"sv);
+    FilterInfo crop("crop"sv);
+    crop.AddParam("120"sv);
+    crop.AddParam("90"sv);
+    FilterInfo gs("gs"sv);
+    std::vector<FilterInfo> infos = {neg, sharp, blur, crop, gs, blur, edge, sharp, edge};
+
+    PipelineOptions tiled_options;
+    tiled_options.tiled = true;
+    tiled_options.threads = 3;
+
+    FiltersPipeline pipeline(infos);
+    FiltersPipeline tiled_pipeline(infos, tiled_options);
+
+    std::stringstream plan;
+    tiled_pipeline.Explain(plan);
+    REQUIRE(plan.str() == "1. tiled(-neg -sharp -blur 1.5)\n2. -crop 120 90\n"
+                          "3. tiled(-gs -blur 1.5 -edge 0.05 -sharp)\n4. -edge 0.05\n");
+
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+
+    pipeline.Apply(img1);
+    tiled_pipeline.Apply(img2);
+    REQUIRE(img1 == img2);
+
+    img1.LoadFromBMP(path1);
+    img2.LoadFromBMP(path1);
+    std::stringstream mask1;
+    std::stringstream mask2;
+    pipeline.ApplyAsMask(img1).Export(mask1);
+    tiled_pipeline.ApplyAsMask(img2).Export(mask2);
+    REQUIRE(mask1.str() == mask2.str());
+}
+
+TEST_CASE("BatchProcessor") {
+    FilterInfo sharp("sharp"sv);
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1"sv);
+    std::vector<FilterInfo> infos = {sharp, blur};
+
+    PipelineOptions options;
+    options.threads = 3;
+    FiltersPipeline pipeline(infos, options);
+
+    // A header claiming more pixels than the file holds fails before anything is allocated.
+    const std::string damaged_path = TestPath("damaged.bmp");
+    {
+        std::ifstream input(path1, std::ios_base::binary);
+        std::string file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        const uint32_t huge = 0x7fffffff;
+        std::memcpy(file.data() + sizeof(Bitmap::BMPHeader) + 4, &huge, sizeof(huge));
+        std::memcpy(file.data() + sizeof(Bitmap::BMPHeader) + 8, &huge, sizeof(huge));
+        std::ofstream(damaged_path, std::ios_base::binary) << file;
+    }
+
+    std::vector<BatchJob> jobs = {{path1, TestPath("batch_1.bmp")},
+                                  {TestPath("missing.bmp"), TestPath("batch_2.bmp")},
+                                  {damaged_path, TestPath("batch_4.bmp")},
+                                  {path1, TestPath("batch_3.bmp")}};
+    BatchOptions batch_options;
+    batch_options.max_images = 2;
+    REQUIRE(BatchProcessor(pipeline, batch_options).Run(jobs) == 2);
+
+    Bitmap expected;
+    expected.LoadFromBMP(path1);
+    pipeline.Apply(expected).ExportAsBMP(TestPath("batch_expected.bmp"));
+    expected.LoadFromBMP(TestPath("batch_expected.bmp"));
+
+    Bitmap img1;
+    Bitmap img3;
+    img1.LoadFromBMP(TestPath("batch_1.bmp"));
+    img3.LoadFromBMP(TestPath("batch_3.bmp"));
+    REQUIRE(img1 == expected);
+    REQUIRE(img3 == expected);
+}
+
+TEST_CASE("AdmissionControl") {
+    FilterInfo gs("gs"sv);
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1"sv);
+    std::vector<FilterInfo> point_infos = {gs};
+    std::vector<FilterInfo> blur_infos = {gs, blur};
+
+    REQUIRE(FiltersPipeline(point_infos).EstimateMemory(10, 5, 24) == 10 * 5 * sizeof(Color));
+    REQUIRE(FiltersPipeline(blur_infos).EstimateMemory(10, 5, 24) == 2 * 10 * 5 * sizeof(Color));
+    REQUIRE(FiltersPipeline(point_infos).EstimateMemory(10, 5, 1) == 10 * 5 * sizeof(Color) + 5 * 4);
+
+    AdmissionController admission(100, 3);
+    REQUIRE(admission.CanAdmit(150));
+    admission.Admit(150);
+    REQUIRE_FALSE(admission.CanAdmit(1));
+    admission.Release(150);
+    admission.Admit(40);
+    admission.Admit(40);
+    REQUIRE_FALSE(admission.CanAdmit(30));
+    REQUIRE(admission.CanAdmit(20));
+    admission.Admit(20);
+    REQUIRE(admission.IsFull());
+    REQUIRE(admission.GetPeakBytes() == 150);
+
+    PipelineOptions options;
+    options.threads = 4;
+    FiltersPipeline pipeline(blur_infos, options);
+    Bitmap::DIBHeader header = Bitmap::ReadDIBHeader(path1);
+    size_t job_memory = pipeline.EstimateMemory(header.image_width, header.image_height, 24);
+
+    BatchOptions batch_options;
+    batch_options.memory_limit = job_memory * 3 / 2;
+    BatchProcessor processor(pipeline, batch_options);
+    REQUIRE(processor.Run({{path1, TestPath("batch_1.bmp")}, {path1, TestPath("batch_2.bmp")}}) == 0);
+    REQUIRE(processor.GetPeakMemory() == job_memory);
+
+    // A file of unknown size takes the whole limit, so it runs alone.
+    batch_options.memory_limit = job_memory * 3;
+    BatchProcessor unknown_processor(pipeline, batch_options);
+    REQUIRE(unknown_processor.Run({{path1, TestPath("batch_1.bmp")},
+                                   {TestPath("missing.bmp"), TestPath("batch_2.bmp")},
+                                   {path1, TestPath("batch_3.bmp")}}) == 1);
+    REQUIRE(unknown_processor.GetPeakMemory() == job_memory * 3);
+}
+
+TEST_CASE("ResultCache") {
+    REQUIRE(Hash64::Compute("") == 0xEF46DB3751D8E999ULL);
+    REQUIRE(Hash64::Compute("abc") == 0x44BC2CF5AD770999ULL);
+    REQUIRE(ResultCache::MakeKey("input", "-gs") != ResultCache::MakeKey("input", "-neg"));
+
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1.50"sv);
+    FilterInfo other_blur("blur"sv);
+    other_blur.AddParam("1.5"sv);
+    std::vector<FilterInfo> infos = {blur};
+    std::vector<FilterInfo> other_infos = {other_blur};
+    FiltersPipeline pipeline(infos);
+    FiltersPipeline other_pipeline(other_infos);
+    REQUIRE(pipeline.GetCanonicalPlan() == other_pipeline.GetCanonicalPlan());
+
+    const std::string directory = TestPath("cache");
+    std::filesystem::remove_all(directory);
+    ResultCache cache(directory, 1 << 20);
+    BatchOptions options;
+    options.cache = &cache;
+
+    BatchProcessor(pipeline, options).Process({path1, TestPath("cache_1.bmp")});
+    BatchProcessor(other_pipeline, options).Process({path1, TestPath("cache_2.bmp")});
+    REQUIRE(cache.GetStats().misses == 1);
+    REQUIRE(cache.GetStats().hits == 1);
+
+    Bitmap img1;
+    Bitmap img2;
+    img1.LoadFromBMP(TestPath("cache_1.bmp"));
+    img2.LoadFromBMP(TestPath("cache_2.bmp"));
+    REQUIRE(img1 == img2);
+
+    // A limit of one entry keeps only the last output stored.
+    FilterInfo gs("gs"sv);
+    std::vector<FilterInfo> gs_infos = {gs};
+    FiltersPipeline gs_pipeline(gs_infos);
+    ResultCache small_cache(directory, std::filesystem::file_size(TestPath("cache_1.bmp")));
+    options.cache = &small_cache;
+    BatchProcessor(gs_pipeline, options).Process({path1, TestPath("cache_1.bmp")});
+    REQUIRE(small_cache.GetStats().evictions == 1);
+    BatchProcessor(pipeline, options).Process({path1, TestPath("cache_1.bmp")});
+    REQUIRE(small_cache.GetStats().misses == 2);
+    REQUIRE(small_cache.GetStats().hits == 0);
+    REQUIRE(small_cache.GetStats().evictions == 2);
+
+    // An output larger than the whole limit is not stored, and evicts nothing.
+    ResultCache tiny_cache(directory, 1);
+    options.cache = &tiny_cache;
+    BatchProcessor(gs_pipeline, options).Process({path1, TestPath("cache_1.bmp")});
+    REQUIRE(tiny_cache.GetStats().evictions == 0);
+    REQUIRE(std::distance(std::filesystem::directory_iterator(directory), std::filesystem::directory_iterator()) == 1);
+
+    // Temporary files are unique per call, and the ones a crashed writer left behind are removed
+    // when the cache is opened next, unless they may still be in use.
+    const std::string key = ResultCache::MakeKey("input", "-gs");
+    const std::string stale_path = small_cache.CreateTemporaryFile(key);
+    const std::string fresh_path = small_cache.CreateTemporaryFile(key);
+    REQUIRE(!stale_path.empty());
+    REQUIRE(stale_path != fresh_path);
+    std::filesystem::last_write_time(stale_path,
+                                     std::filesystem::file_time_type::clock::now() - std::chrono::hours(2));
+    ResultCache reopened_cache(directory, 1 << 20);
+    REQUIRE(!std::filesystem::exists(stale_path));
+    REQUIRE(std::filesystem::exists(fresh_path));
+}
+
+TEST_CASE("Checkpoints") {
+    const std::string directory = TestPath("checkpoints");
+    std::filesystem::remove_all(directory);
+    ResultCache checkpoints(directory, 1 << 26, ".raw");
+    PipelineOptions options;
+    options.checkpoints = &checkpoints;
+
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1.5"sv);
+    FilterInfo sharp("sharp"sv);
+    std::vector<FilterInfo> neg_infos = {blur, sharp, FilterInfo("neg"sv)};
+    std::vector<FilterInfo> gs_infos = {blur, sharp, FilterInfo("gs"sv)};
+    FiltersPipeline neg_pipeline(neg_infos, options);
+    FiltersPipeline gs_pipeline(gs_infos, options);
+    FiltersPipeline plain_pipeline(gs_infos);
+
+    Bitmap img1;
+    img1.LoadFromBMP(path1);
+    neg_pipeline.Apply(img1);
+    REQUIRE(checkpoints.GetStats().misses == 2);
+    REQUIRE(checkpoints.GetStats().hits == 0);
+
+    // The second chain shares the blur and sharpening stages and resumes after them.
+    Bitmap img2;
+    Bitmap img3;
+    img2.LoadFromBMP(path1);
+    img3.LoadFromBMP(path1);
+    gs_pipeline.Apply(img2);
+    plain_pipeline.Apply(img3);
+    REQUIRE(checkpoints.GetStats().hits == 1);
+    REQUIRE(img2 == img3);
+
+    // A checkpoint with a damaged size is run again from the input rather than failing the image.
+    for (const auto& file : std::filesystem::directory_iterator(directory)) {
+        std::fstream checkpoint(file.path(), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        const uint32_t damaged_size[] = {0x7fffffff, 0x7fffffff};
+        checkpoint.seekp(sizeof(Bitmap::BMPHeader) + sizeof(uint32_t));
+        checkpoint.write(reinterpret_cast<const char*>(damaged_size), sizeof(damaged_size));
+    }
+    Bitmap img4;
+    img4.LoadFromBMP(path1);
+    gs_pipeline.Apply(img4);
+    REQUIRE(img4 == img3);
+
+    // Images larger than the whole limit are not kept.
+    const std::string small_directory = TestPath("small_checkpoints");
+    std::filesystem::remove_all(small_directory);
+    ResultCache small_checkpoints(small_directory, 1024, ".raw");
+    options.checkpoints = &small_checkpoints;
+    FiltersPipeline small_pipeline(neg_infos, options);
+    Bitmap img5;
+    img5.LoadFromBMP(path1);
+    small_pipeline.Apply(img5);
+    REQUIRE(small_checkpoints.GetStats().misses == 2);
+    REQUIRE(std::filesystem::is_empty(small_directory));
+}
+
+TEST_CASE("StageStats") {
+    StageStats stats;
+    PipelineOptions options;
+    options.stats = &stats;
+    options.threads = 2;
+
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1"sv);
+    FilterInfo crop("crop"sv);
+    crop.AddParam("10"sv);
+    crop.AddParam("10"sv);
+    std::vector<FilterInfo> infos = {FilterInfo("gs"sv), blur, crop};
+    FiltersPipeline pipeline(infos, options);
+    BatchProcessor processor(pipeline);
+    processor.Process({path1, TestPath("stats_1.bmp")});
+    processor.Process({path1, TestPath("stats_1.bmp")});
+
+    Bitmap image;
+    image.LoadFromBMP(path1);
+    const uint64_t pixels = static_cast<uint64_t>(image.GetWidth()) * image.GetHeight();
+
+    const auto stages = stats.GetStages();
+    REQUIRE(stages.size() == 5);
+    REQUIRE(stages[0].name == "load");
+    REQUIRE(stages[1].name == "-gs");
+    REQUIRE(stages[2].name == "-blur 1");
+    REQUIRE(stages[3].name == "-crop 10 10");
+    REQUIRE(stages[4].name == "export");
+    for (const auto& stage : stages) {
+        REQUIRE(stage.calls == 2);
+        REQUIRE(stage.total.wall_seconds >= 0);
+    }
+    REQUIRE(stages[2].total.pixels == 2 * pixels);
+    REQUIRE(stages[2].total.bytes_read == 2 * 2 * pixels * sizeof(Color));
+    REQUIRE(stages[3].total.pixels == 0);
+    REQUIRE(stages[4].total.pixels == 2 * 100);
+
+    std::ostringstream json;
+    stats.ReportJson(json);
+    REQUIRE(json.str().find("{\"name\": \"-blur 1\", \"calls\": 2") != std::string::npos);
+
+    // Hardware counts are summed like the rest, and read as zeros where counters are not allowed.
+    StageStats counter_stats(true);
+    StageStats::Sample sample;
+    sample.pixels = 1000;
+    sample.counts.cycles = 2000;
+    sample.counts.instructions = 3000;
+    sample.counts.cache_misses = 10;
+    counter_stats.Record("-gs", sample);
+    counter_stats.Record("-gs", sample);
+    REQUIRE(counter_stats.GetStages()[0].total.counts.instructions == 6000);
+    std::ostringstream table;
+    counter_stats.ReportTable(table);
+    REQUIRE(table.str().find("IPC") != std::string::npos);
+    if (!PerfCounters::IsAvailable()) {
+        REQUIRE(PerfCounters::Read().cycles == 0);
+    }
+}
+
+TEST_CASE("Trace") {
+    TraceRecorder trace;
+    PipelineOptions options;
+    options.trace = &trace;
+    options.threads = 2;
+
+    FilterInfo blur("blur"sv);
+    blur.AddParam("1"sv);
+    std::vector<FilterInfo> infos = {FilterInfo("gs"sv), blur};
+    FiltersPipeline pipeline(infos, options);
+    BatchProcessor(pipeline).Process({path1, TestPath("trace_1.bmp")});
+
+    std::ostringstream stream;
+    trace.Write(stream);
+    const std::string json = stream.str();
+    REQUIRE(json.rfind("{\"traceEvents\": [", 0) == 0);
+    REQUIRE(json.find("{\"name\": \"image\", \"cat\": \"image\", \"ph\": \"X\"") != std::string::npos);
+    REQUIRE(json.find("{\"name\": \"load\", \"cat\": \"io\"") != std::string::npos);
+    REQUIRE(json.find("{\"name\": \"-blur 1\", \"cat\": \"stage\"") != std::string::npos);
+    REQUIRE(json.find("{\"name\": \"-blur 1\", \"cat\": \"tile\"") != std::string::npos);
+    REQUIRE(json.find("\"ph\": \"M\"") != std::string::npos);
+}
+
+// Sends one request line to a served socket and returns the response, payload included.
+static std::string ServerRequest(const std::string& socket_path, const std::string& request) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    socket_path.copy(address.sun_path, socket_path.size());
+    REQUIRE(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+    REQUIRE(write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+    shutdown(fd, SHUT_WR);
+
+    std::string response;
+    char buffer[4096];
+    for (ssize_t size; (size = read(fd, buffer, sizeof(buffer))) > 0;) {
+        response.append(buffer, size);
+    }
+    close(fd);
+    return response;
+}
+
+TEST_CASE("Server") {
+    const std::string socket_path = TestPath("test.sock");
+    Server server(socket_path, 2);
+    std::thread server_thread([&server]() { server.Run(); });
+
+    std::ifstream input_file(path1, std::ios_base::binary);
+    std::string input((std::istreambuf_iterator<char>(input_file)), std::istreambuf_iterator<char>());
+
+    Bitmap expected;
+    expected.LoadFromBMP(path1);
+    SharpeningFilter().Apply(expected);
+    std::stringstream expected_output;
+    expected.Export(expected_output);
+
+    std::string response = ServerRequest(socket_path, "- - -sharp\n" + input + "missing.bmp - -sharp\n");
+    REQUIRE(response == "OK " + std::to_string(expected_output.str().size()) + "\n" + expected_output.str() +
+                        "ERROR Input file cannot be opened.\n");
+    REQUIRE(ServerRequest(socket_path, "- - -unknown\n" + input) == "ERROR Unknown filter was provided.\n");
+
+    // The header is checked against the bytes sent before anything is allocated for it.
+    std::string huge = input.substr(0, 154);
+    const uint32_t huge_file_size = huge.size();
+    const uint32_t huge_side = 40000;
+    std::memcpy(huge.data() + 2, &huge_file_size, sizeof(huge_file_size));
+    std::memcpy(huge.data() + sizeof(Bitmap::BMPHeader) + 4, &huge_side, sizeof(huge_side));
+    std::memcpy(huge.data() + sizeof(Bitmap::BMPHeader) + 8, &huge_side, sizeof(huge_side));
+    REQUIRE(ServerRequest(socket_path, "- - -sharp\n" + huge) ==
+            "ERROR File is shorter than the image size in its header.\n");
+    std::string paletted = input;
+    const uint16_t paletted_bits = 8;
+    std::memcpy(paletted.data() + sizeof(Bitmap::BMPHeader) + 14, &paletted_bits, sizeof(paletted_bits));
+    REQUIRE(ServerRequest(socket_path, "- - -sharp\n" + paletted) ==
+            "ERROR Only uncompressed 24-bit BMP files are supported.\n");
+
+    // Options ahead of the paths still leave the inline input to the request it belongs to.
+    response = ServerRequest(socket_path, "--optimize - - -sharp\n" + input + "missing.bmp - -sharp\n");
+    REQUIRE(response == "OK " + std::to_string(expected_output.str().size()) + "\n" + expected_output.str() +
+                        "ERROR Input file cannot be opened.\n");
+
+    server.Stop();
+    server_thread.join();
+
+    // A file that is not a socket is never replaced.
+    const std::string file_path = TestPath("not_a_socket.bmp");
+    std::ofstream(file_path) << "keep";
+    REQUIRE_THROWS_AS(Server(file_path, 1), AppError);
+    REQUIRE(std::filesystem::file_size(file_path) == 4);
 }
 
 TEST_CASE("FiltersPipeline") {